@@ -0,0 +1,624 @@
+//
+// load generator for the master and content servers
+//
+// unless pointed at running servers with --master / --content, starts
+// bin/master.js and bin/content.js on ephemeral ports, then:
+//
+//   master:  opens --clients websocket clients that subscribe, has
+//            --servers fake game servers heartbeat and answer getinfo
+//            (each answer is broadcast to every subscriber) and has
+//            --pollers clients send getservers back to back
+//   content: has --http-clients clients fetch the manifest and random
+//            assets back to back, gzip'd like a browser would
+//
+// for --duration seconds each. latency percentiles (ms), throughput and
+// the servers' rss (KB) are written as JSON to stdout or --out. opening
+// thousands of clients needs a matching `ulimit -n`
+//
+var async = require('async');
+var child_process = require('child_process');
+var fs = require('fs');
+var http = require('http');
+var os = require('os');
+var path = require('path');
+var temp = require('temp');
+var WebSocket = require('ws');
+
+var argv = require('optimist')
+	.options({
+		'clients': {
+			'description': 'Subscribed WebSocket clients to open against the master server',
+			'default': 1000
+		},
+		'servers': {
+			'description': 'Fake game servers heartbeating to the master server',
+			'default': 10
+		},
+		'pollers': {
+			'description': 'WebSocket clients sending getservers back to back',
+			'default': 50
+		},
+		'http-clients': {
+			'description': 'HTTP clients fetching from the content server',
+			'default': 50
+		},
+		'duration': {
+			'description': 'Seconds to run each server\'s load for',
+			'default': 10
+		},
+		'connect-concurrency': {
+			'description': 'WebSocket handshakes in flight at once',
+			'default': 100
+		},
+		'master': {
+			'description': 'host:port of a running master server, one is started otherwise'
+		},
+		'content': {
+			'description': 'host:port of a running content server, one is started otherwise'
+		},
+		'content-root': {
+			'description': 'Asset directory for the started content server, synthetic assets otherwise'
+		},
+		'skip': {
+			'description': 'Skip the master or content server\'s load'
+		},
+		'out': {
+			'description': 'File to write the JSON report to, stdout otherwise'
+		}
+	})
+	.argv;
+
+if (argv.h || argv.help) {
+	require('optimist').showHelp();
+	return;
+}
+
+var OOB = new Buffer([0xff, 0xff, 0xff, 0xff]);
+var GETSERVERS_RESPONSE = 'getserversResponse';
+var RESPONSE_TIMEOUT = 5000;
+var RSS_INTERVAL = 500;
+
+function log(msg) {
+	console.error('[load] ' + msg);
+}
+
+/**********************************************************
+ *
+ * measurements
+ *
+ **********************************************************/
+function Stats() {
+	this.samples = [];
+	this.errors = 0;
+	this.bytes = 0;
+}
+
+Stats.prototype.start = function () {
+	var self = this;
+	var start = process.hrtime();
+
+	return function () {
+		var elapsed = process.hrtime(start);
+		self.samples.push(elapsed[0] * 1e3 + elapsed[1] / 1e6);
+	};
+};
+
+Stats.prototype.summary = function (seconds) {
+	var sorted = this.samples.slice().sort(function (a, b) { return a - b; });
+	var sum = sorted.reduce(function (a, b) { return a + b; }, 0);
+
+	function round(v) {
+		return Math.round(v * 1000) / 1000;
+	}
+
+	function percentile(p) {
+		return sorted.length ? round(sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))]) : null;
+	}
+
+	var summary = {
+		count: sorted.length,
+		errors: this.errors,
+		latency: {
+			min: percentile(0),
+			mean: sorted.length ? round(sum / sorted.length) : null,
+			p50: percentile(0.5),
+			p90: percentile(0.9),
+			p99: percentile(0.99),
+			p999: percentile(0.999),
+			max: percentile(1)
+		}
+	};
+
+	if (seconds) {
+		summary.throughput = round(sorted.length / seconds);
+		if (this.bytes) {
+			summary.bytesPerSecond = Math.round(this.bytes / seconds);
+		}
+	}
+
+	return summary;
+};
+
+function readRss(pid, callback) {
+	fs.readFile('/proc/' + pid + '/status', 'utf8', function (err, status) {
+		var match = !err && status.match(/VmRSS:\s+(\d+) kB/);
+		if (match) {
+			return callback(null, parseInt(match[1], 10));
+		}
+
+		child_process.execFile('ps', ['-o', 'rss=', '-p', String(pid)], function (err, stdout) {
+			if (err) return callback(err);
+			callback(null, parseInt(stdout, 10));
+		});
+	});
+}
+
+// samples a process' rss in KB until stop() is called
+function RssSampler(pid) {
+	var self = this;
+
+	this.pid = pid;
+	this.start = null;
+	this.peak = 0;
+	this.end = null;
+
+	function sample() {
+		readRss(pid, function (err, rss) {
+			if (err || isNaN(rss)) return;
+			if (self.start === null) self.start = rss;
+			self.peak = Math.max(self.peak, rss);
+			self.end = rss;
+		});
+	}
+
+	sample();
+	this.timer = setInterval(sample, RSS_INTERVAL);
+}
+
+RssSampler.prototype.stop = function () {
+	clearInterval(this.timer);
+	return { start: this.start, peak: this.peak, end: this.end };
+};
+
+/**********************************************************
+ *
+ * servers
+ *
+ **********************************************************/
+function startServer(script, config, callback) {
+	var configFile = temp.path({ suffix: '.json' });
+	fs.writeFileSync(configFile, JSON.stringify(config));
+
+	var child = child_process.spawn(process.execPath, [path.join(__dirname, '..', 'bin', script), '--config', configFile], {
+		stdio: ['ignore', 'pipe', 'pipe']
+	});
+	var output = '';
+	var started = false;
+
+	function onData(data) {
+		if (started) return;  // keep draining so the server never blocks on its logging
+
+		output += data;
+
+		var match = output.match(/listening on port (?:\S+ )?(\d+)/);
+		if (match) {
+			started = true;
+			callback(null, { child: child, host: '127.0.0.1', port: parseInt(match[1], 10) });
+		}
+	}
+
+	child.stdout.on('data', onData);
+	child.stderr.on('data', onData);
+	child.on('exit', function (code) {
+		fs.unlink(configFile, function () {});
+		if (!started) {
+			started = true;
+			callback(new Error(script + ' exited with ' + code + ':\n' + output));
+		}
+	});
+}
+
+function parseAddress(str) {
+	var split = str.split(':');
+	return { host: split[0], port: parseInt(split[1], 10) };
+}
+
+/**********************************************************
+ *
+ * master
+ *
+ **********************************************************/
+function formatOOB(str) {
+	var buffer = new Buffer(4 + str.length + 1);
+	OOB.copy(buffer);
+	buffer.write(str, 4, str.length, 'binary');
+	buffer[buffer.length - 1] = 0;
+	return buffer;
+}
+
+function isOOB(data, prefix) {
+	return data.length > 4 + prefix.length &&
+		data.readInt32BE(0) === -1 &&
+		data.toString('binary', 4, 4 + prefix.length) === prefix;
+}
+
+// returns the ports of the servers in a getserversResponse
+function parseGetServersResponse(data) {
+	var ports = [];
+	var offset = 4 + GETSERVERS_RESPONSE.length;
+	// each server is \ followed by 4 address octets and a port, then \EOT and \0
+	var count = Math.floor((data.length - offset - 5) / 7);
+
+	for (var i = 0; i < count; i++, offset += 7) {
+		ports.push(data.readUInt16BE(offset + 5));
+	}
+
+	return ports;
+}
+
+function connectClients(address, count, concurrency, stats, callback) {
+	var agent = new http.Agent();
+	agent.maxSockets = concurrency;
+
+	var indices = [];
+	for (var i = 0; i < count; i++) indices.push(i);
+
+	async.mapLimit(indices, concurrency, function (i, cb) {
+		var done = stats.start();
+		var ws = new WebSocket('ws://' + address.host + ':' + address.port, { agent: agent });
+
+		function onError(err) {
+			stats.errors++;
+			cb(null, null);
+		}
+
+		ws.once('error', onError);
+		ws.once('open', function () {
+			done();
+			ws.removeListener('error', onError);
+			ws.on('error', function () {});
+			cb(null, ws);
+		});
+	}, function (err, sockets) {
+		callback(err, sockets.filter(function (ws) { return ws; }));
+	});
+}
+
+function runMaster(address, sampler, callback) {
+	var stats = {
+		connect: new Stats(),
+		subscribe: new Stats(),
+		getservers: new Stats(),
+		heartbeat: new Stats(),
+		broadcast: new Stats()
+	};
+	var total = argv.clients + argv.servers + argv.pollers;
+
+	log('opening ' + total + ' websocket clients against ' + address.host + ':' + address.port);
+
+	connectClients(address, total, argv['connect-concurrency'], stats.connect, function (err, sockets) {
+		if (err) return callback(err);
+
+		var subscribers = sockets.slice(0, argv.clients);
+		var servers = sockets.slice(argv.clients, argv.clients + argv.servers);
+		var pollers = sockets.slice(argv.clients + argv.servers);
+		var pending = {};  // fake server port -> outstanding broadcast
+
+		log('subscribing ' + subscribers.length + ' clients');
+
+		async.each(subscribers, function (ws, cb) {
+			var done = stats.subscribe.start();
+			var timeout = setTimeout(function () {
+				stats.subscribe.errors++;
+				cb();
+			}, RESPONSE_TIMEOUT);
+
+			ws.once('message', function () {
+				clearTimeout(timeout);
+				done();
+				cb();
+
+				// everything after the subscribe response is a broadcast
+				ws.on('message', function (data) {
+					if (!isOOB(data, GETSERVERS_RESPONSE)) return;
+
+					parseGetServersResponse(data).forEach(function (port) {
+						var broadcast = pending[port];
+						if (!broadcast) return;
+
+						broadcast.received();
+						if (--broadcast.remaining === 0) {
+							broadcast.complete();
+						}
+					});
+				});
+			});
+
+			ws.send(formatOOB('subscribe'), { binary: true });
+		}, function () {
+			var end = Date.now() + argv.duration * 1000;
+
+			log('running heartbeats and getservers for ' + argv.duration + 's');
+
+			// each fake server heartbeats, answers getinfo and waits for the
+			// resulting broadcast to reach every subscriber before going again
+			function heartbeatLoop(ws, cb) {
+				var port = ws._socket.localPort;
+
+				if (Date.now() >= end) return cb();
+
+				var done = stats.heartbeat.start();
+				var timeout = setTimeout(function () {
+					stats.heartbeat.errors++;
+					ws.removeAllListeners('message');
+					heartbeatLoop(ws, cb);
+				}, RESPONSE_TIMEOUT);
+
+				ws.once('message', function (data) {
+					clearTimeout(timeout);
+					done();
+
+					if (!isOOB(data, 'getinfo ')) {
+						stats.heartbeat.errors++;
+						return heartbeatLoop(ws, cb);
+					}
+
+					var challenge = data.toString('binary', 4 + 'getinfo '.length, data.length - 1);
+					var broadcast = pending[port] = {
+						remaining: subscribers.length,
+						// one sample per subscriber, all timed from the infoResponse
+						received: stats.broadcast.start(),
+						complete: function () {
+							clearTimeout(broadcast.timeout);
+							delete pending[port];
+							heartbeatLoop(ws, cb);
+						}
+					};
+					broadcast.timeout = setTimeout(function () {
+						stats.broadcast.errors += broadcast.remaining;
+						broadcast.complete();
+					}, RESPONSE_TIMEOUT);
+
+					if (!subscribers.length) {
+						return broadcast.complete();
+					}
+
+					ws.send(formatOOB('infoResponse\n\\challenge\\' + challenge + '\\hostname\\load\\protocol\\68\\clients\\0'), { binary: true });
+				});
+
+				ws.send(formatOOB('heartbeat QuakeArena-1\n'), { binary: true });
+			}
+
+			function getserversLoop(ws, cb) {
+				if (Date.now() >= end) return cb();
+
+				var done = stats.getservers.start();
+				var timeout = setTimeout(function () {
+					stats.getservers.errors++;
+					ws.removeAllListeners('message');
+					getserversLoop(ws, cb);
+				}, RESPONSE_TIMEOUT);
+
+				ws.once('message', function (data) {
+					clearTimeout(timeout);
+					done();
+					if (!isOOB(data, GETSERVERS_RESPONSE)) stats.getservers.errors++;
+					getserversLoop(ws, cb);
+				});
+
+				ws.send(formatOOB('getservers 68 empty full'), { binary: true });
+			}
+
+			var start = Date.now();
+
+			async.parallel([
+				function (cb) { async.each(servers, heartbeatLoop, cb); },
+				function (cb) { async.each(pollers, getserversLoop, cb); }
+			], function () {
+				var seconds = (Date.now() - start) / 1000;
+
+				sockets.forEach(function (ws) {
+					ws.terminate();
+				});
+
+				callback(null, {
+					clients: subscribers.length,
+					servers: servers.length,
+					pollers: pollers.length,
+					connect: stats.connect.summary(),
+					subscribe: stats.subscribe.summary(),
+					getservers: stats.getservers.summary(seconds),
+					heartbeat: stats.heartbeat.summary(seconds),
+					broadcast: stats.broadcast.summary(seconds),
+					rss: sampler ? sampler.stop() : null
+				});
+			});
+		});
+	});
+}
+
+/**********************************************************
+ *
+ * content
+ *
+ **********************************************************/
+// a spread of pak sizes, about half of each is compressible
+function createAssets() {
+	var root = temp.mkdirSync('content');
+	var sizes = [16, 64, 256, 1024, 4096];
+
+	fs.mkdirSync(path.join(root, 'baseq3'));
+
+	sizes.forEach(function (kb, i) {
+		var data = new Buffer(kb * 1024);
+		for (var j = 0; j < data.length; j++) {
+			data[j] = j & 1 ? (Math.random() * 256) | 0 : j & 0xff;
+		}
+		fs.writeFileSync(path.join(root, 'baseq3', 'pak' + i + '.pk3'), data);
+	});
+
+	return root;
+}
+
+function get(agent, address, urlPath, stats, callback) {
+	var done = stats.start();
+
+	var req = http.get({
+		agent: agent,
+		host: address.host,
+		port: address.port,
+		path: urlPath,
+		headers: { 'Accept-Encoding': 'gzip' }
+	}, function (res) {
+		var chunks = [];
+
+		res.on('data', function (chunk) {
+			chunks.push(chunk);
+			stats.bytes += chunk.length;
+		});
+		res.on('end', function () {
+			done();
+			if (res.statusCode !== 200) stats.errors++;
+			callback(null, Buffer.concat(chunks), res);
+		});
+	});
+
+	req.on('error', function (err) {
+		stats.errors++;
+		callback(err);
+	});
+}
+
+function runContent(address, sampler, callback) {
+	var stats = {
+		manifest: new Stats(),
+		asset: new Stats()
+	};
+	var agent = new http.Agent();
+	agent.maxSockets = argv['http-clients'];
+
+	log('fetching manifest from ' + address.host + ':' + address.port);
+
+	get(agent, address, '/assets/manifest.json', new Stats(), function (err, body, res) {
+		if (err) return callback(err);
+
+		var zlib = require('zlib');
+		var decode = res.headers['content-encoding'] === 'gzip' ? zlib.gunzip : function (b, cb) { cb(null, b); };
+
+		decode(body, function (err, json) {
+			if (err) return callback(err);
+
+			var assets = JSON.parse(json.toString('utf8')).map(function (entry) {
+				var dir = path.dirname(entry.name);
+				return '/assets/' + (dir === '.' ? '' : dir + '/') + entry.checksum + '-' + path.basename(entry.name);
+			});
+
+			if (!assets.length) {
+				return callback(new Error('content server has no assets'));
+			}
+
+			log('fetching the manifest and ' + assets.length + ' assets with ' + argv['http-clients'] + ' clients for ' + argv.duration + 's');
+
+			var start = Date.now();
+			var end = start + argv.duration * 1000;
+			var workers = [];
+			for (var i = 0; i < argv['http-clients']; i++) workers.push(i);
+
+			// one in ten requests is for the manifest, like a client
+			// checking for updates between downloads
+			async.each(workers, function (i, cb) {
+				(function next() {
+					if (Date.now() >= end) return cb();
+
+					if (Math.random() < 0.1) {
+						get(agent, address, '/assets/manifest.json', stats.manifest, function () { next(); });
+					} else {
+						var asset = assets[(Math.random() * assets.length) | 0];
+						get(agent, address, asset, stats.asset, function () { next(); });
+					}
+				})();
+			}, function () {
+				var seconds = (Date.now() - start) / 1000;
+
+				callback(null, {
+					httpClients: argv['http-clients'],
+					assets: assets.length,
+					manifest: stats.manifest.summary(seconds),
+					asset: stats.asset.summary(seconds),
+					rss: sampler ? sampler.stop() : null
+				});
+			});
+		});
+	});
+}
+
+/**********************************************************
+ *
+ * main
+ *
+ **********************************************************/
+function withServer(script, address, config, run, callback) {
+	if (address) {
+		return run(parseAddress(address), null, callback);
+	}
+
+	startServer(script, config, function (err, server) {
+		if (err) return callback(err);
+
+		log('started ' + script + ' on port ' + server.port);
+
+		run(server, new RssSampler(server.child.pid), function (err, result) {
+			server.child.kill();
+			callback(err, result);
+		});
+	});
+}
+
+(function main() {
+	var report = {
+		timestamp: new Date().toISOString(),
+		node: process.version,
+		platform: os.platform() + ' ' + os.arch(),
+		cpus: os.cpus().length,
+		duration: argv.duration
+	};
+	var generator = new RssSampler(process.pid);
+
+	async.series([
+		function (cb) {
+			if (argv.skip === 'master') return cb();
+
+			withServer('master.js', argv.master, { port: 0 }, runMaster, function (err, result) {
+				report.master = result;
+				cb(err);
+			});
+		},
+		function (cb) {
+			if (argv.skip === 'content') return cb();
+
+			var root = argv['content-root'] ? path.resolve(argv['content-root']) : createAssets();
+
+			withServer('content.js', argv.content, { port: 0, root: root }, runContent, function (err, result) {
+				report.content = result;
+				cb(err);
+			});
+		}
+	], function (err) {
+		report.generator = { rss: generator.stop() };
+
+		if (err) {
+			log(err.stack || err);
+			process.exit(1);
+		}
+
+		var json = JSON.stringify(report, null, 2);
+
+		if (argv.out) {
+			fs.writeFileSync(argv.out, json + '\n');
+		} else {
+			console.log(json);
+		}
+
+		process.exit(0);
+	});
+})();
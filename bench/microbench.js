@@ -0,0 +1,289 @@
+//
+// microbenchmarks for the native code on the websocket and repak paths
+//
+// times the shipped bindings the way the servers call them: ws's
+// bufferUtil.mask / unmask / merge and Validation.isValidUTF8 /
+// Validation#unmask, and execSync.exec (a `sh -c` with its output sent
+// to a temp file) against execSync.spawn. if ws's bufferutil_bench was
+// built, its per-kernel numbers are included too
+//
+// throughput is in GB/s, latencies in microseconds and rss in KB, written
+// as JSON to stdout or --out
+//
+var async = require('async');
+var child_process = require('child_process');
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+
+var argv = require('optimist')
+	.options({
+		'spawn-iterations': {
+			'description': 'Programs to run with each of execSync.exec and execSync.spawn',
+			'default': 200
+		},
+		'out': {
+			'description': 'File to write the JSON report to, stdout otherwise'
+		}
+	})
+	.argv;
+
+if (argv.h || argv.help) {
+	require('optimist').showHelp();
+	return;
+}
+
+var WS = path.join(__dirname, '..', 'node_modules', 'ws');
+var BYTES_PER_RUN = 64 * 1024 * 1024;
+var MAX_FRAME = 1024 * 1024;
+var MERGE_FRAGMENTS = 16;
+
+function log(msg) {
+	console.error('[microbench] ' + msg);
+}
+
+function round(v) {
+	return Math.round(v * 1000) / 1000;
+}
+
+// whether ws picked up its compiled addon rather than the JS fallback
+function isNative(name) {
+	try {
+		require(path.join(WS, 'build', 'Release', name));
+		return true;
+	} catch (e) {
+		return false;
+	}
+}
+
+// runs fn(i) enough times to push BYTES_PER_RUN bytes through, returns GB/s
+function throughput(length, fn) {
+	var iterations = Math.max(16, Math.floor(BYTES_PER_RUN / length));
+	var i;
+
+	for (i = 0; i < iterations / 16; i++) fn(i);
+
+	var start = process.hrtime();
+	for (i = 0; i < iterations; i++) fn(i);
+	var elapsed = process.hrtime(start);
+
+	return round(length * iterations / (elapsed[0] + elapsed[1] / 1e9) / 1e9);
+}
+
+function latencies(samples) {
+	samples.sort(function (a, b) { return a - b; });
+
+	var sum = samples.reduce(function (a, b) { return a + b; }, 0);
+	var n = samples.length;
+
+	return {
+		count: n,
+		min: round(samples[0]),
+		mean: round(sum / n),
+		p50: round(samples[Math.floor(n * 0.5)]),
+		p90: round(samples[Math.floor(n * 0.9)]),
+		p99: round(samples[Math.floor(n * 0.99)]),
+		max: round(samples[n - 1])
+	};
+}
+
+// fills `length` bytes by repeating `text`, without splitting a character
+function repeat(text, length) {
+	var unit = new Buffer(text);
+	var buffer = new Buffer(length);
+	var offset = 0;
+
+	while (offset + unit.length <= length) {
+		unit.copy(buffer, offset);
+		offset += unit.length;
+	}
+	buffer.fill(0x20, offset);
+
+	return buffer;
+}
+
+/**********************************************************
+ *
+ * ws
+ *
+ **********************************************************/
+function benchKernels(callback) {
+	var bin = path.join(WS, 'build', 'Release', 'bufferutil_bench');
+
+	if (!fs.existsSync(bin)) {
+		log('ws\'s bufferutil_bench isn\'t built, skipping the per-kernel numbers');
+		return callback(null, null);
+	}
+
+	child_process.execFile(bin, function (err, stdout) {
+		if (err) return callback(err);
+		callback(null, JSON.parse(stdout));
+	});
+}
+
+function benchBindings() {
+	var bufferUtil = require(path.join(WS, 'lib', 'BufferUtil')).BufferUtil;
+	var Validation = require(path.join(WS, 'lib', 'Validation')).Validation;
+	var validation = new Validation();
+
+	// payloads start one byte into a buffer, like the receiver's pooled ones
+	var source = new Buffer(MAX_FRAME + 1).slice(1);
+	var output = new Buffer(MAX_FRAME + 1).slice(1);
+	var mask = new Buffer([0x37, 0xfa, 0x21, 0x3d]);
+	for (var i = 0; i < MAX_FRAME; i++) source[i] = (i * 31) & 0xff;
+
+	var result = {
+		bufferutil: isNative('bufferutil') ? 'native' : 'fallback',
+		validation: isNative('validation') ? 'native' : 'fallback',
+		mask: [],
+		unmask: [],
+		merge: [],
+		utf8: []
+	};
+
+	for (var length = 16; length <= MAX_FRAME; length *= 4) {
+		var from = source.slice(0, length);
+
+		result.mask.push({ size: length, gbps: throughput(length, function () {
+			bufferUtil.mask(from, mask, output, 0, length);
+		}) });
+		result.unmask.push({ size: length, gbps: throughput(length, function () {
+			bufferUtil.unmask(from, mask);
+		}) });
+	}
+
+	for (length = 1024; length <= MAX_FRAME; length *= 4) {
+		var fragments = [];
+		for (var f = 0; f < MERGE_FRAGMENTS; f++) {
+			fragments.push(source.slice(f * length / MERGE_FRAGMENTS, (f + 1) * length / MERGE_FRAGMENTS));
+		}
+
+		result.merge.push({ size: length, fragments: MERGE_FRAGMENTS, gbps: throughput(length, function () {
+			bufferUtil.merge(output, fragments);
+		}) });
+	}
+
+	var texts = {
+		ascii: '{"type":"chat","text":"gg wp, rematch?"} ',
+		latin: 'café naïve résumé über straße ',
+		cjk: '你好世界 こんにちは '
+	};
+
+	Object.keys(texts).forEach(function (name) {
+		[64, 4096, 65536].forEach(function (size) {
+			var text = repeat(texts[name], size);
+
+			if (!Validation.isValidUTF8(text)) {
+				throw new Error(name + ' text rejected by isValidUTF8');
+			}
+
+			// the receiver hands Validation#unmask masked frames, so mask the
+			// text once up front. output is a separate buffer, so every call
+			// unmasks the same masked bytes
+			var masked = new Buffer(size);
+			bufferUtil.mask(text, mask, masked, 0, size);
+
+			result.utf8.push({
+				text: name,
+				size: size,
+				isValidUTF8: throughput(size, function () {
+					Validation.isValidUTF8(text);
+				}),
+				// the receiver's fused unmask + validate + copy
+				unmask: throughput(size, function () {
+					// finish() resets the validator for the next message, one left
+					// rejected would skip the work on every later call
+					if (validation.unmask(masked, mask, output, 0) < 0 || !validation.finish()) {
+						throw new Error(name + ' text rejected by Validation#unmask');
+					}
+				})
+			});
+		});
+	});
+
+	return result;
+}
+
+/**********************************************************
+ *
+ * execSync
+ *
+ **********************************************************/
+function benchSpawn(iterations, callback) {
+	var sh;
+
+	try {
+		sh = require('execSync');
+	} catch (e) {
+		log('execSync isn\'t built, skipping spawn latency (' + e.message + ')');
+		return callback(null, null);
+	}
+
+	var exec = [];
+	for (var i = 0; i < iterations; i++) {
+		var start = process.hrtime();
+		sh.exec('true');
+		var elapsed = process.hrtime(start);
+		exec.push(elapsed[0] * 1e6 + elapsed[1] / 1e3);
+	}
+
+	var spawn = [];
+	(function next() {
+		if (spawn.length === iterations) {
+			return callback(null, { exec: latencies(exec), spawn: latencies(spawn) });
+		}
+
+		var start = process.hrtime();
+		sh.spawn('true', [], function (err, result) {
+			if (err) return callback(err);
+			if (result.code !== 0) return callback(new Error('true exited with ' + result.code));
+
+			var elapsed = process.hrtime(start);
+			spawn.push(elapsed[0] * 1e6 + elapsed[1] / 1e3);
+			next();
+		});
+	})();
+}
+
+(function main() {
+	var report = {
+		timestamp: new Date().toISOString(),
+		node: process.version,
+		platform: os.platform() + ' ' + os.arch(),
+		cpus: os.cpus().length
+	};
+
+	async.series([
+		function (cb) {
+			benchKernels(function (err, kernels) {
+				report.kernels = kernels;
+				cb(err);
+			});
+		},
+		function (cb) {
+			report.bindings = benchBindings();
+			cb();
+		},
+		function (cb) {
+			benchSpawn(Math.max(1, argv['spawn-iterations']), function (err, spawn) {
+				report.spawn = spawn;
+				cb(err);
+			});
+		}
+	], function (err) {
+		if (err) {
+			log(err.stack || err);
+			process.exit(1);
+		}
+
+		report.rss = Math.round(process.memoryUsage().rss / 1024);
+
+		var json = JSON.stringify(report, null, 2);
+
+		if (argv.out) {
+			fs.writeFileSync(argv.out, json + '\n');
+		} else {
+			console.log(json);
+		}
+	});
+})();
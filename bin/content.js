@@ -1,15 +1,14 @@
 var _ = require('underscore');
 var async = require('async');
-var crc32 = require('buffer-crc32');
 var express = require('express');
 var fs = require('fs');
 var http = require('http');
 var logger = require('winston');
+var manifest = require('../lib/manifest');
 var opt = require('optimist');
 var path = require('path');
 var send = require('send');
 var wrench = require('wrench');
-var zlib = require('zlib');
 
 var argv = require('optimist')
 	.describe('config', 'Location of the configuration file').default('config', './config.json')
@@ -27,6 +26,7 @@ var config = loadConfig(argv.config);
 var validAssets = ['.pk3', '.run', '.sh'];
 var currentManifestTimestamp;
 var currentManifest;
+var currentAssetIndex;
 
 function getAssets() {
 	return wrench.readdirSyncRecursive(config.root).filter(function (file) {
@@ -37,59 +37,136 @@ function getAssets() {
 	});
 }
 
+function loadManifestCache() {
+	try {
+		return JSON.parse(fs.readFileSync(config.cache, 'utf8'));
+	} catch (e) {
+		return {};
+	}
+}
+
+function saveManifestCache(cache) {
+	try {
+		fs.writeFileSync(config.cache, JSON.stringify(cache));
+	} catch (e) {
+		logger.warn('failed to write manifest cache to ' + config.cache, e);
+	}
+}
+
 function generateManifest(callback) {
-	logger.info('generating manifest from ' + config.root);
+	logger.info('generating manifest from ' + config.root + (manifest.native ? '' : ' (native scanner unavailable)'));
 
 	var assets = getAssets();
 	var start = Date.now();
+	var cache = loadManifestCache();
+	var nextCache = {};
+	var scanned = 0;
 
 	async.map(assets, function (file, cb) {
-		logger.info('processing ' + file);
-
 		var name = path.relative(config.root, file);
-		var crc = crc32.unsigned('');
-		var compressed = 0;
-		var size = 0;
 
-		// stream each file in, generating a hash for it's original
-		// contents, and gzip'ing the buffer to determine the compressed
-		// length for the client so it can present accurate progress info
-		var stream = fs.createReadStream(file);
+		fs.stat(file, function (err, stats) {
+			if (err) return cb(err);
 
-		// gzip the file contents to determine the compressed length
-		// of the file so the client can present correct progress info
-		var gzip = zlib.createGzip();
+			// reuse the previous scan if the file hasn't changed since and its
+			// gzip'd copy, if it's worth keeping one, is still intact
+			var cached = cache[name];
+			var gzipFile = file + '.gz';
+			if (cached && cached.size === stats.size && cached.mtime === stats.mtime.getTime()) {
+				var gzipStats;
+				try {
+					gzipStats = fs.statSync(gzipFile);
+				} catch (e) {
+				}
 
-		stream.on('error', function (err) {
-			callback(err);
-		});
-		stream.on('data', function (data) {
-			crc = crc32.unsigned(data, crc);
-			size += data.length;
-			gzip.write(data);
-		});
-		stream.on('end', function () {
-			gzip.end();
-		});
+				if (cached.gzip === false || (cached.gzip && gzipStats && gzipStats.size === cached.compressed)) {
+					nextCache[name] = cached;
+					return cb(null, { name: name, compressed: cached.compressed, checksum: cached.checksum, gzip: cached.gzip });
+				}
+			}
 
-		gzip.on('data', function (data) {
-			compressed += data.length;
-		});
-		gzip.on('end', function () {
-			cb(null, {
-				name: name,
-				compressed: compressed,
-				checksum: crc
+			logger.info('processing ' + file);
+			scanned++;
+
+			function done(info, gzip) {
+				// compressed is what the client will download, for its progress
+				var entry = {
+					size: stats.size,
+					mtime: stats.mtime.getTime(),
+					compressed: gzip ? info.compressed : stats.size,
+					checksum: info.checksum,
+					gzip: gzip
+				};
+				nextCache[name] = entry;
+
+				cb(null, { name: name, compressed: entry.compressed, checksum: entry.checksum, gzip: gzip });
+			}
+
+			function serveRaw(info) {
+				// drop a copy left from when the asset did compress
+				fs.unlink(gzipFile, function () {
+					done(info, false);
+				});
+			}
+
+			// the gzip'd copy is written next to the asset, and served in
+			// place of compressing the asset on every request. pk3s are zips
+			// already and often come out larger, those are served as is
+			manifest.scan(file, gzipFile + '.tmp', function (err, info) {
+				if (err) {
+					// a read-only root or a full disk shouldn't keep the server
+					// from starting, scan again without the copy and serve raw
+					logger.warn('failed to write ' + gzipFile + ', serving ' + name + ' uncompressed', err.message);
+
+					return manifest.scan(file, function (err, info) {
+						if (err) return cb(err);
+						serveRaw(info);
+					});
+				}
+
+				if (info.compressed >= stats.size) {
+					return fs.unlink(gzipFile + '.tmp', function () {
+						serveRaw(info);
+					});
+				}
+
+				fs.rename(gzipFile + '.tmp', gzipFile, function (err) {
+					if (err) {
+						logger.warn('failed to write ' + gzipFile + ', serving ' + name + ' uncompressed', err.message);
+
+						return fs.unlink(gzipFile + '.tmp', function () {
+							serveRaw(info);
+						});
+					}
+
+					done(info, true);
+				});
 			});
 		});
 	}, function (err, entries) {
 		if (err) return callback(err);
-		logger.info('generated manifest (' + entries.length + ' entries) in ' + ((Date.now() - start) / 1000) + ' seconds');
+		logger.info('generated manifest (' + entries.length + ' entries, ' + scanned + ' scanned) in ' + ((Date.now() - start) / 1000) + ' seconds');
+
+		saveManifestCache(nextCache);
 
 		callback(err, entries);
 	});
 }
 
+function assetKey(name, checksum) {
+	return name + '@' + checksum;
+}
+
+function indexManifest(manifest) {
+	var index = {};
+
+	manifest.forEach(function (entry) {
+		index[assetKey(entry.name, entry.checksum)] = entry;
+	});
+
+	return index;
+}
+
 function handleManifest(req, res, next) {
 	logger.info('serving manifest to ' + req.ip);
 
@@ -107,15 +184,7 @@ function handleAsset(req, res, next) {
 	var absolutePath = path.join(config.root, relativePath);
 
 	// make sure they're requesting a valid asset
-	var asset;
-	for (var i = 0; i < currentManifest.length; i++) {
-		var entry = currentManifest[i];
-
-		if (entry.name === relativePath && entry.checksum === checksum) {
-			asset = entry;
-			break;
-		}
-	}
+	var asset = currentAssetIndex[assetKey(relativePath, checksum)];
 
 	if (!asset) {
 		res.status(400).end();
@@ -124,7 +193,21 @@ function handleAsset(req, res, next) {
 
 	logger.info('serving ' + relativePath + ' (crc32 ' + checksum + ') to ' + req.ip);
 
-	res.sendfile(absolutePath, { maxAge: Infinity });
+	// asset urls include the checksum, so it doubles as a strong etag
+	res.setHeader('Vary', 'Accept-Encoding');
+
+	if (!asset.gzip || !req.acceptsEncoding('gzip')) {
+		res.setHeader('ETag', '"' + checksum + '"');
+		res.sendfile(absolutePath, { maxAge: Infinity });
+		return;
+	}
+
+	// send takes care of Content-Length, Range and conditional requests for
+	// the precompressed body
+	res.setHeader('Content-Encoding', 'gzip');
+	res.setHeader('Content-Type', send.mime.lookup(absolutePath));
+	res.setHeader('ETag', '"' + checksum + '-gzip"');
+	res.sendfile(absolutePath + '.gz', { maxAge: Infinity });
 }
 
 function loadConfig(configPath) {
@@ -141,6 +224,9 @@ function loadConfig(configPath) {
 		logger.warn('failed to load config', e);
 	}
 
+	// scan results are cached by path, size and mtime across restarts
+	config.cache = config.cache || path.join(config.root, '.manifest-cache.json');
+
 	return config;
 }
 
@@ -150,8 +236,7 @@ function loadConfig(configPath) {
 		res.setHeader('Access-Control-Allow-Origin', '*');
 		next();
 	});
-	app.use(express.compress({ filter: function(req, res) { return true; } }));
-	app.get('/assets/manifest.json', handleManifest);
+	app.get('/assets/manifest.json', express.compress(), handleManifest);
 	app.get(/^\/assets\/(.+\/|)(\d+)-(.+?)$/, handleAsset);
 
 	// generate an initial manifest
@@ -159,7 +244,11 @@ function loadConfig(configPath) {
 		if (err) throw err;
 
 		currentManifestTimestamp = new Date();
-		currentManifest = manifest;
+		// whether an asset has a gzip'd copy is only the server's business
+		currentManifest = manifest.map(function (entry) {
+			return _.pick(entry, 'name', 'compressed', 'checksum');
+		});
+		currentAssetIndex = indexManifest(manifest);
 
 		// start listening
 		var server = http.createServer(app);
@@ -3,6 +3,7 @@ var http = require('http');
 var logger = require('winston');
 var opt = require('optimist');
 var url = require('url');
+var PreparedFrame = require('ws').PreparedFrame;
 var WebSocketClient = require('ws');
 var WebSocketServer = require('ws').Server;
 
@@ -23,17 +24,23 @@ var clients = [];
 var servers = {};
 var pruneInterval = 350 * 1000;
 
-function formatOOB(data) {
-	var str = '\xff\xff\xff\xff' + data + '\x00';
+function prepareOOB(length) {
+	// leading -1 and trailing \0
+	var frame = new PreparedFrame(4 + length + 1, { binary: true });
+	var payload = frame.payload;
 
-	var buffer = new ArrayBuffer(str.length);
-	var view = new Uint8Array(buffer);
+	payload[0] = payload[1] = payload[2] = payload[3] = 0xff;
+	payload[payload.length - 1] = 0;
 
-	for (var i = 0; i < str.length; i++) {
-		view[i] = str.charCodeAt(i);
-	}
+	return frame;
+}
+
+function formatOOB(data) {
+	var frame = prepareOOB(data.length);
+
+	frame.payload.write(data, 4, data.length, 'binary');
 
-	return buffer;
+	return frame;
 }
 
 function stripOOB(buffer) {
@@ -117,34 +124,63 @@ function sendGetInfo(conn) {
 
 	logger.info(conn.addr + ':' + conn.port + ' <--- getinfo with challenge \"' + challenge + '\"');
 
-	var buffer = formatOOB('getinfo ' + challenge);
-	conn.socket.send(buffer, { binary: true });
+	var frame = formatOOB('getinfo ' + challenge);
+	conn.socket.sendFrame(frame);
 }
 
-function sendGetServersResponse(conn, servers) {
-	var msg = 'getserversResponse';
-	for (var id in servers) {
-		if (!servers.hasOwnProperty(id)) {
-			continue;
-		}
-		var server = servers[id];
-		var octets = server.addr.split('.').map(function (n) {
-			return parseInt(n, 10);
-		});
-		msg += '\\';
-		msg += String.fromCharCode(octets[0] & 0xff);
-		msg += String.fromCharCode(octets[1] & 0xff);
-		msg += String.fromCharCode(octets[2] & 0xff)
-		msg += String.fromCharCode(octets[3] & 0xff);
-		msg += String.fromCharCode((server.port & 0xff00) >> 8);
-		msg += String.fromCharCode(server.port & 0xff);
+var GETSERVERS_RESPONSE = 'getserversResponse';
+var GETSERVERS_EOT = '\\EOT';
+
+function encodeGetServersResponse(servers) {
+	var ids = Object.keys(servers);
+
+	// each server is written as \ followed by 4 address octets and a
+	// big endian port
+	var length = GETSERVERS_RESPONSE.length + ids.length * 7 + GETSERVERS_EOT.length;
+	var frame = prepareOOB(length);
+	var payload = frame.payload;
+	var offset = 4;
+
+	offset += payload.write(GETSERVERS_RESPONSE, offset, GETSERVERS_RESPONSE.length, 'binary');
+
+	for (var i = 0; i < ids.length; i++) {
+		var server = servers[ids[i]];
+		var octets = server.addr.split('.');
+
+		payload[offset++] = 0x5c;  // '\\'
+		payload[offset++] = parseInt(octets[0], 10) & 0xff;
+		payload[offset++] = parseInt(octets[1], 10) & 0xff;
+		payload[offset++] = parseInt(octets[2], 10) & 0xff;
+		payload[offset++] = parseInt(octets[3], 10) & 0xff;
+		payload[offset++] = (server.port & 0xff00) >> 8;
+		payload[offset++] = server.port & 0xff;
 	}
-	msg += '\\EOT';
 
+	payload.write(GETSERVERS_EOT, offset, GETSERVERS_EOT.length, 'binary');
+
+	return frame;
+}
+
+function sendGetServersResponse(conn, servers) {
 	logger.info(conn.addr + ':' + conn.port + ' <--- getserversResponse with ' + Object.keys(servers).length + ' server(s)');
 
-	var buffer = formatOOB(msg);
-	conn.socket.send(buffer, { binary: true });
+	var frame = encodeGetServersResponse(servers);
+	conn.socket.sendFrame(frame);
+}
+
+function broadcastGetServersResponse(conns, servers) {
+	logger.info('<--- getserversResponse with ' + Object.keys(servers).length + ' server(s) to ' + conns.length + ' client(s)');
+
+	// encode and frame once, every client is sent the same bytes
+	var frame = encodeGetServersResponse(servers);
+
+	conns.forEach(function (conn) {
+		conn.socket.sendFrame(frame, function (err) {
+			if (err) {
+				logger.warn(conn.addr + ':' + conn.port + ' failed to send getserversResponse: ' + err.message);
+			}
+		});
+	});
 }
 
 /**********************************************************
@@ -165,9 +201,7 @@ function updateServer(addr, port) {
 	server.lastUpdate = Date.now();
 
 	// send partial update to all clients
-	for (var i = 0; i < clients.length; i++) {
-		sendGetServersResponse(clients[i], { id: server });
-	}
+	broadcastGetServersResponse(clients, { id: server });
 }
 
 function removeServer(id) {
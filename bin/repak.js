@@ -3,9 +3,9 @@ var async = require('async');
 var fs = require('fs');
 var logger = require('winston');
 var path = require('path');
-var exec = require('child_process').exec;
-var execSync = require('execSync').exec;
 var os = require('os');
+var sh = require('execSync');
+var pk3 = require('../lib/pk3');
 var temp = require('temp');
 var wrench = require('wrench');
 
@@ -141,33 +141,38 @@ function getPaks(root) {
 	});
 }
 
-function extractPak(pak, dest) {
-	logger.info('extracting pak ' + pak);
-
-	execSync('unzip -o ' + pak + ' -d ' + dest);
-}
-
 function flattenPaks(paks) {
-	var tempDir = temp.mkdirSync('flattened');
+	var files = {};
 
-	// sort the paks in ascending order before extracting
+	// sort the paks in ascending order so later paks override
+	// earlier ones, same as the game's search order
 	paks = paks.sort();
 
 	paks.forEach(function (pak) {
-		extractPak(pak, tempDir);
+		logger.info('reading pak ' + pak);
+
+		pk3.readDirectory(pak).forEach(function (entry) {
+			// skip directory entries
+			if (entry.name.charAt(entry.name.length - 1) === '/') {
+				return;
+			}
+
+			entry.pak = pak;
+			files[entry.name] = entry;
+		});
 	});
 
-	return tempDir;
+	return files;
 }
 
-function graphGame(graph, game, root) {
+function graphGame(graph, game, files) {
 	var gameConfig = config.games[game];
 	var gameBlacklist = new MatchList((gameConfig ? gameConfig.exclude : []).concat(blacklist));
 	var gameWhitelist = new MatchList((gameConfig ? gameConfig.include : []).concat(whitelist));
 
 	function graphFile(name) {
-		var file = path.join(root, name);
-		var ext = path.extname(file).toLowerCase();
+		var entry = files[name];
+		var ext = path.extname(name).toLowerCase();
 
 		var v;
 
@@ -178,73 +183,102 @@ function graphGame(graph, game, root) {
 			var mapConfig = gameConfig && gameConfig.maps[mapName];
 			var mapWhitelist = mapConfig && new MatchList(mapConfig.include);
 
-			v = graph.addMap(name, game, fs.readFileSync(file), mapWhitelist);
+			v = graph.addMap(name, game, pk3.read(entry.pak, entry), mapWhitelist);
 		} else if (ext === '.md3') {
-			v = graph.addModel(name, game, fs.readFileSync(file));
+			v = graph.addModel(name, game, pk3.read(entry.pak, entry));
 		} else if (ext === '.shader') {
-			v = graph.addScript(name, game, fs.readFileSync(file));
+			v = graph.addScript(name, game, pk3.read(entry.pak, entry));
 		} else if (ext === '.skin') {
-			v = graph.addSkin(name, game, fs.readFileSync(file));
+			v = graph.addSkin(name, game, pk3.read(entry.pak, entry));
 		} else if (ext === '.jpg' || ext === '.tga') {
 			v = graph.addTexture(name, game);
 		} else {
 			v = graph.addMisc(name, game);
 		}
 
-		// add filename to node for help resolving later
-		v.data.path = { root: root, name: name };
+		// add pak entry to node for help resolving later
+		v.data.entry = entry;
 
 		return v;
 	}
 
 	var gameV = graph.addGame(game, gameWhitelist);
 
-	var files = wrench.readdirSyncRecursive(root).filter(function (file) {
-		var absolute = path.join(root, file);
+	Object.keys(files).filter(function (name) {
+		return !gameBlacklist.matches(name);
+	}).forEach(function (name) {
+		graphFile(name);
+	});
+}
 
-		if (gameBlacklist.matches(file)) {
-			return false;
-		}
+var transcodes = {};
+var transformed = {};
 
-		var stats = fs.lstatSync(absolute);
-		return stats.isFile();
-	});
+function entryKey(entry) {
+	return entry.pak + ':' + entry.name;
+}
 
-	files.forEach(function (file) {
-		graphFile(file);
-	});
+function needsTransform(entry) {
+	return entry.name.indexOf('.wav') !== -1;
 }
 
-function transformFile(src) {
-	if (src.indexOf('.wav') === -1) {
-		return src;
-	}
+// returns the pak entry to write for an asset, or the loose file to be
+// compressed while writing if the asset was transcoded
+function transformFile(entry) {
+	return transformed[entryKey(entry)] || entry;
+}
 
-	var dest = src.replace('.wav', '.opus');
+// transcodes every asset vertsToFileMap has come across, running one
+// opusenc per core
+function transformFiles(callback) {
+	var keys = Object.keys(transcodes);
+	var tempDir = keys.length && temp.mkdirSync('transcode');
+
+	// paks from different games can have files with the same name,
+	// so each gets its own directory
+	async.each(keys.map(function (key, i) {
+		return { entry: transcodes[key], dir: path.join(tempDir, String(i)) };
+	}), function (job, cb) {
+		var entry = job.entry;
+		var src = path.join(job.dir, entry.name);
+		var dest = src.replace('.wav', '.opus');
+
+		wrench.mkdirSyncRecursive(path.dirname(src));
+		fs.writeFileSync(src, pk3.read(entry.pak, entry));
+
+		// do the transform
+		sh.spawn('opusenc', [src, dest], function (err, result) {
+			if (err || result.code) {
+				logger.error('.. failed to opus encode ' + entry.name);
+				return cb();
+			}
 
-	// do the transform
-	var result = execSync('opusenc ' + src + ' ' + dest);
-	if (result.code) {
-		logger.error('.. failed to opus encode ' + src);
-		return src;
-	}
+			transformed[entryKey(entry)] = {
+				name: entry.name.replace('.wav', '.opus'),
+				file: dest
+			};
 
-	return dest;
+			cb();
+		});
+	}, callback);
 }
 
 function vertsToFileMap(verts) {
 	var fileMap = {};
 
 	verts.forEach(function (v) {
-		if (!v.data.path) {
+		if (!v.data.entry) {
 			logger.warn('missing asset ' + v.id);
 			return;
 		}
 
-		var absolute = transformFile(path.join(v.data.path.root, v.data.path.name));
-		var relative = path.relative(v.data.path.root, absolute);
+		var entry = v.data.entry;
 
-		fileMap[relative] = absolute;
+		if (needsTransform(entry)) {
+			transcodes[entryKey(entry)] = entry;
+		}
+
+		fileMap[entry.name] = entry;
 	});
 
 	return fileMap;
@@ -256,62 +290,37 @@ function writePak(pak, fileMap, splitThreshold, callback) {
 		splitThreshold = undefined;
 	}
 
-	var part = 100;
-	var currentPak = nextPartName(pak);
-	var files = Object.keys(fileMap).sort();
+	var names = Object.keys(fileMap).sort();
 
-	function nextPartName(pak) {
-		if (splitThreshold) {
-			var ext = path.extname(pak);
-			pak = pak.replace(ext, part + ext);
-			part++;
-		}
-		return pak;
-	}
+	// entries from the source paks are copied over still compressed,
+	// transcoded files are compressed on the threadpool
+	async.map(names, function (name, cb) {
+		var file = transformFile(fileMap[name]);
 
-	function nextFile() {
-		if (!files.length) {
-			return callback();
+		if (!file.file) {
+			return cb(null, file);
 		}
 
-		var relative = files.shift();
-		var absolute = fileMap[relative];
-		var baseDir = path.normalize(absolute.replace(relative, ''));
-
-		exec('zip \"' + currentPak + '\" \"' + relative + '\"', { cwd: baseDir }, function (err) {
+		pk3.deflate(file.file, function (err, entry) {
 			if (err) return cb(err);
-
-			if (splitThreshold) {
-				var stats = fs.statSync(currentPak);
-
-				if (stats.size >= splitThreshold) {
-					// went over the threshold, remove the file from the
-					// zip and put it into the next part
-					exec('zip -d \"' + currentPak + '\" \"' + relative + '\"', { cwd: baseDir }, function (err) {
-						if (err) return cb(err);
-
-						files.unshift(relative);
-
-						currentPak = nextPartName(pak);
-
-						logger.info('writing ' + currentPak);
-
-						nextFile();
-					});
-
-					return;
-				}
-			}
-
-			nextFile();
+			entry.name = file.name;
+			cb(null, entry);
 		});
-	}
+	}, function (err, entries) {
+		if (err) return callback(err);
 
-	logger.info('writing ' + currentPak);
+		// every entry's compressed size is known now, so the split points
+		// can be decided before writing anything
+		var parts = pk3.split(pak, entries, splitThreshold);
 
-	wrench.mkdirSyncRecursive(path.dirname(currentPak));
+		wrench.mkdirSyncRecursive(path.dirname(pak));
 
-	nextFile();
+		async.each(parts, function (part, cb) {
+			logger.info('writing ' + part.name);
+
+			pk3.write(part.name, part.entries, cb);
+		}, callback);
+	});
 }
 
 //
@@ -334,9 +343,9 @@ getGames(src).forEach(function (game) {
 	var paks = getPaks(dir).map(function (pak) {
 		return path.join(dir, pak);
 	});
-	var flattened = flattenPaks(paks);
+	var files = flattenPaks(paks);
 
-	graphGame(graph, game, flattened);
+	graphGame(graph, game, files);
 });
 
 //
@@ -394,6 +403,10 @@ tasks.push(function (cb) {
 	writePak(pakName, fileMap, commonPakMaxSize, cb);
 });
 
-async.parallelLimit(tasks, os.cpus().length, function (err) {
+transformFiles(function (err) {
 	if (err) throw err;
+
+	async.parallelLimit(tasks, os.cpus().length, function (err) {
+		if (err) throw err;
+	});
 });
@@ -0,0 +1,16 @@
+{
+  'targets': [
+    {
+      'target_name': 'manifest',
+      'include_dirs': ["<!(node -e \"require('nan')\")"],
+      'cflags': [ '-O3' ],
+      'sources': [ 'src/manifest.cc' ]
+    },
+    {
+      'target_name': 'pk3',
+      'include_dirs': ["<!(node -e \"require('nan')\")"],
+      'cflags': [ '-O3' ],
+      'sources': [ 'src/pk3.cc' ]
+    }
+  ]
+}
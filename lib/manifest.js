@@ -0,0 +1,85 @@
+var crc32 = require('buffer-crc32');
+var fs = require('fs');
+var zlib = require('zlib');
+
+var native;
+try {
+	native = require('../build/Release/manifest');
+} catch (e) {
+	native = null;
+}
+
+// stream the file in, generating a hash for its original contents
+// and gzip'ing it to determine the compressed length for the client
+// so it can present accurate progress info. a gzipFile that can't be
+// written fails the scan, and is removed
+function scanStream(file, gzipFile, callback) {
+	if (callback === undefined) {
+		callback = gzipFile;
+		gzipFile = undefined;
+	}
+
+	var crc = crc32.unsigned('');
+	var compressed = 0;
+	var size = 0;
+	var failed = false;
+
+	var stream = fs.createReadStream(file);
+	var gzip = zlib.createGzip();
+	var output = gzipFile ? fs.createWriteStream(gzipFile) : null;
+
+	function fail(err) {
+		if (failed) return;
+		failed = true;
+
+		if (!output) return callback(err);
+
+		// don't leave a truncated copy behind
+		output.destroy();
+		fs.unlink(gzipFile, function () {
+			callback(err);
+		});
+	}
+
+	function done() {
+		if (failed) return;
+		callback(null, {
+			size: size,
+			checksum: crc,
+			compressed: compressed
+		});
+	}
+
+	stream.on('error', fail);
+	stream.on('data', function (data) {
+		crc = crc32.unsigned(data, crc);
+		size += data.length;
+		gzip.write(data);
+	});
+	stream.on('end', function () {
+		gzip.end();
+	});
+
+	gzip.on('data', function (data) {
+		compressed += data.length;
+		if (output) output.write(data);
+	});
+	gzip.on('end', function () {
+		if (!output) return done();
+		output.end();
+	});
+
+	if (output) {
+		output.on('error', fail);
+		output.on('close', done);
+	}
+}
+
+//
+// scan(file, [gzipFile], callback) calls back with the file's size, CRC-32
+// and gzip'd size, saving the gzip'd contents to gzipFile if given. the
+// native version maps the file and does the work on a threadpool
+// worker, so scanning many files at once uses every worker in the pool
+//
+module.exports.scan = native ? native.scan : scanStream;
+module.exports.native = !!native;
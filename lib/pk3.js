@@ -0,0 +1,59 @@
+var path = require('path');
+
+var pk3;
+try {
+	pk3 = require('../build/Release/pk3');
+} catch (e) {
+	throw new Error('the pk3 addon isn\'t built, check builderror.log and re-run npm install (' + e.message + ')');
+}
+
+//
+// readDirectory(pak) returns the pak's entries, read(pak, entry) returns an
+// entry's uncompressed contents, deflate(file, callback) compresses a loose
+// file on a threadpool worker and write(pak, entries, callback) writes a
+// new pak in one pass, also on a worker. entries from readDirectory() with
+// their `pak` set are copied over without being recompressed
+//
+module.exports.readDirectory = pk3.readDirectory;
+module.exports.read = pk3.read;
+module.exports.deflate = pk3.deflate;
+module.exports.write = pk3.write;
+
+// bytes an entry adds to a pak: its local header and data, plus its
+// central directory record
+module.exports.entrySize = function (entry) {
+	var nameLength = Buffer.byteLength(entry.name);
+	return 30 + nameLength + entry.compressedSize + 46 + nameLength;
+};
+
+// bytes every pak has regardless of its entries
+module.exports.END_SIZE = 22;
+
+// groups entries, in order, into the paks to write. with a maxSize each
+// pak is kept under it (an entry larger than maxSize gets a pak of its
+// own) and the paks are named after `pak` with 100, 101, .. appended,
+// pak.pk3 becoming pak100.pk3, pak101.pk3, ... returns [{ name, entries }]
+module.exports.split = function (pak, entries, maxSize) {
+	var parts = [];
+	var current = null;
+	var size = 0;
+
+	entries.forEach(function (entry) {
+		var entrySize = module.exports.entrySize(entry);
+
+		if (!current || (maxSize && size + entrySize >= maxSize)) {
+			current = [];
+			size = module.exports.END_SIZE;
+			parts.push(current);
+		}
+
+		current.push(entry);
+		size += entrySize;
+	});
+
+	return parts.map(function (entries, i) {
+		var ext = path.extname(pak);
+		var name = maxSize ? pak.slice(0, pak.length - ext.length) + (100 + i) + ext : pak;
+		return { name: name, entries: entries };
+	});
+};
@@ -0,0 +1,201 @@
+#ifndef QUAKEJS_ASSET_H
+#define QUAKEJS_ASSET_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <string>
+#include <zlib.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "crc32.h"
+
+/*
+ * Everything the content server's manifest needs to know about an asset:
+ * its size, CRC-32 and the size of its gzip encoding. asset_scan() gets
+ * all three in a single pass over the file, mapping it into memory where
+ * the platform allows, and can save the gzip encoding so it never has to
+ * be produced again while serving.
+ */
+
+struct asset_info {
+	uint64_t size;
+	uint32_t checksum;
+	uint64_t compressed;
+};
+
+#define ASSET_CHUNK (1024 * 1024)
+
+struct asset_scanner {
+	z_stream zs;
+	uint32_t crc;
+	uint64_t size;
+	uint64_t compressed;
+	FILE *output;
+	int write_error;
+	unsigned char out[64 * 1024];
+};
+
+static bool asset_scanner_init(asset_scanner *scanner)
+{
+	memset(&scanner->zs, 0, sizeof(scanner->zs));
+	scanner->crc = 0;
+	scanner->size = 0;
+	scanner->compressed = 0;
+	scanner->output = NULL;
+	scanner->write_error = 0;
+
+	// same settings as zlib.createGzip(), which express.compress uses
+	return deflateInit2(&scanner->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+	                    15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+static bool asset_scanner_update(asset_scanner *scanner, const uint8_t *data,
+                                 size_t length, bool finish)
+{
+	scanner->crc = crc32_update(scanner->crc, data, length);
+	scanner->size += length;
+
+	scanner->zs.next_in = (Bytef *)data;
+	scanner->zs.avail_in = (uInt)length;
+
+	int ret;
+	do {
+		scanner->zs.next_out = scanner->out;
+		scanner->zs.avail_out = sizeof(scanner->out);
+		ret = deflate(&scanner->zs, finish ? Z_FINISH : Z_NO_FLUSH);
+		if (ret == Z_STREAM_ERROR) {
+			return false;
+		}
+		size_t have = sizeof(scanner->out) - scanner->zs.avail_out;
+		if (scanner->output && fwrite(scanner->out, 1, have, scanner->output) != have) {
+			scanner->write_error = errno;
+			return false;
+		}
+		scanner->compressed += have;
+	} while (scanner->zs.avail_out == 0 || (finish && ret != Z_STREAM_END));
+
+	return true;
+}
+
+/*
+ * Scans `path`. If `gzip_path` isn't NULL the gzip encoding is written
+ * there as well, and removed again if the scan fails.
+ */
+static bool asset_scan(const char *path, const char *gzip_path, asset_info *info, std::string *error)
+{
+	asset_scanner *scanner = new asset_scanner;
+	bool ok = asset_scanner_init(scanner);
+
+	if (!ok) {
+		*error = "failed to initialize zlib";
+		delete scanner;
+		return false;
+	}
+
+	if (gzip_path) {
+		scanner->output = fopen(gzip_path, "wb");
+
+		if (!scanner->output) {
+			*error = std::string(strerror(errno)) + ", open '" + gzip_path + "'";
+			deflateEnd(&scanner->zs);
+			delete scanner;
+			return false;
+		}
+	}
+
+#ifndef _WIN32
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		*error = std::string(strerror(errno)) + ", open '" + path + "'";
+		ok = false;
+	} else if (st.st_size == 0) {
+		ok = asset_scanner_update(scanner, NULL, 0, true);
+	} else {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (map == MAP_FAILED) {
+			*error = std::string(strerror(errno)) + ", mmap '" + path + "'";
+			ok = false;
+		} else {
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+			// feed deflate in chunks, uInt lengths are 32 bit
+			const uint8_t *data = (const uint8_t *)map;
+			size_t remaining = st.st_size;
+			while (ok && remaining > ASSET_CHUNK) {
+				ok = asset_scanner_update(scanner, data, ASSET_CHUNK, false);
+				data += ASSET_CHUNK;
+				remaining -= ASSET_CHUNK;
+			}
+			ok = ok && asset_scanner_update(scanner, data, remaining, true);
+
+			munmap(map, st.st_size);
+		}
+	}
+
+	if (fd != -1) {
+		close(fd);
+	}
+#else
+	FILE *fp = fopen(path, "rb");
+
+	if (!fp) {
+		*error = std::string(strerror(errno)) + ", open '" + path + "'";
+		ok = false;
+	} else {
+		uint8_t *chunk = new uint8_t[ASSET_CHUNK];
+		size_t read;
+		do {
+			read = fread(chunk, 1, ASSET_CHUNK, fp);
+			ok = asset_scanner_update(scanner, chunk, read, read < ASSET_CHUNK);
+		} while (ok && read == ASSET_CHUNK);
+
+		if (ferror(fp)) {
+			*error = std::string(strerror(errno)) + ", read '" + path + "'";
+			ok = false;
+		}
+
+		delete[] chunk;
+		fclose(fp);
+	}
+#endif
+
+	if (ok) {
+		info->size = scanner->size;
+		info->checksum = scanner->crc;
+		info->compressed = scanner->compressed;
+	} else if (scanner->write_error) {
+		*error = std::string(strerror(scanner->write_error)) + ", write '" + gzip_path + "'";
+	} else if (error->empty()) {
+		*error = std::string("failed to compress '") + path + "'";
+	}
+
+	if (scanner->output) {
+		if (fclose(scanner->output) != 0 && ok) {
+			*error = std::string(strerror(errno)) + ", write '" + gzip_path + "'";
+			ok = false;
+		}
+
+		// don't leave a truncated copy behind
+		if (!ok) {
+			remove(gzip_path);
+		}
+	}
+
+	deflateEnd(&scanner->zs);
+	delete scanner;
+
+	return ok;
+}
+
+#endif // QUAKEJS_ASSET_H
@@ -0,0 +1,74 @@
+#ifndef QUAKEJS_CRC32_H
+#define QUAKEJS_CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * CRC-32 (IEEE 802.3, the one zip and gzip use) with the slicing-by-8
+ * table method, consuming 8 input bytes per step. Results match
+ * buffer-crc32's unsigned output, so manifests keep the same checksums.
+ *
+ * crc32_init() must be called once before crc32_update().
+ */
+
+static uint32_t crc32_table[8][256];
+
+static void crc32_init(void)
+{
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (int k = 0; k < 8; k++) {
+			c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		}
+		crc32_table[0][i] = c;
+	}
+
+	for (uint32_t i = 0; i < 256; i++) {
+		for (int t = 1; t < 8; t++) {
+			uint32_t prev = crc32_table[t - 1][i];
+			crc32_table[t][i] = (prev >> 8) ^ crc32_table[0][prev & 0xff];
+		}
+	}
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length)
+{
+	crc = ~crc;
+
+	// byte at a time until aligned so the word loads below are cheap
+	while (length && ((uintptr_t)data & 7)) {
+		crc = crc32_table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+		length--;
+	}
+
+	while (length >= 8) {
+		uint32_t lo, hi;
+		memcpy(&lo, data, 4);
+		memcpy(&hi, data + 4, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		lo = __builtin_bswap32(lo);
+		hi = __builtin_bswap32(hi);
+#endif
+		lo ^= crc;
+		crc = crc32_table[7][lo & 0xff] ^
+		      crc32_table[6][(lo >> 8) & 0xff] ^
+		      crc32_table[5][(lo >> 16) & 0xff] ^
+		      crc32_table[4][lo >> 24] ^
+		      crc32_table[3][hi & 0xff] ^
+		      crc32_table[2][(hi >> 8) & 0xff] ^
+		      crc32_table[1][(hi >> 16) & 0xff] ^
+		      crc32_table[0][hi >> 24];
+		data += 8;
+		length -= 8;
+	}
+
+	while (length--) {
+		crc = crc32_table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+	}
+
+	return ~crc;
+}
+
+#endif // QUAKEJS_CRC32_H
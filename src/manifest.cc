@@ -0,0 +1,82 @@
+#include <node.h>
+#include <string>
+#include "nan.h"
+#include "asset.h"
+
+using namespace v8;
+
+/*
+ * Scans one asset on a libuv threadpool worker. Queuing a worker per file
+ * spreads a manifest build across the whole pool.
+ */
+class ScanWorker : public NanAsyncWorker {
+public:
+	ScanWorker(NanCallback *callback, const std::string &path, const std::string &gzipPath)
+		: NanAsyncWorker(callback), path(path), gzipPath(gzipPath) {}
+
+	void Execute() {
+		ok = asset_scan(path.c_str(), gzipPath.empty() ? NULL : gzipPath.c_str(), &info, &error);
+	}
+
+	void HandleOKCallback() {
+		NanScope();
+
+		if (!ok) {
+			Local<Value> argv[] = { NanError(error.c_str()) };
+			callback->Call(1, argv);
+			return;
+		}
+
+		Local<Object> result = NanNew<Object>();
+		result->Set(NanSymbol("size"), NanNew<Number>((double)info.size));
+		result->Set(NanSymbol("checksum"), NanNew<Number>((double)info.checksum));
+		result->Set(NanSymbol("compressed"), NanNew<Number>((double)info.compressed));
+
+		Local<Value> argv[] = { NanNull(), result };
+		callback->Call(2, argv);
+	}
+
+private:
+	std::string path;
+	std::string gzipPath;
+	std::string error;
+	asset_info info;
+	bool ok;
+};
+
+/**
+ * scan(path, [gzipPath], callback): calls back with (err, { size, checksum,
+ * compressed }), writing the gzip encoding to gzipPath if one is given.
+ */
+NAN_METHOD(Scan) {
+	NanScope();
+
+	int last = args.Length() - 1;
+
+	if (last < 1 || !args[0]->IsString() || !args[last]->IsFunction()) {
+		return NanThrowTypeError("Expected a path and a callback");
+	}
+
+	size_t length;
+	char *path = NanCString(args[0], &length);
+	std::string gzipPath;
+	if (last > 1 && args[1]->IsString()) {
+		size_t gzipLength;
+		char *gzip = NanCString(args[1], &gzipLength);
+		gzipPath.assign(gzip, gzipLength);
+		delete[] gzip;
+	}
+	NanCallback *callback = new NanCallback(args[last].As<Function>());
+	NanAsyncQueueWorker(new ScanWorker(callback, std::string(path, length), gzipPath));
+	delete[] path;
+
+	NanReturnUndefined();
+}
+
+void Init(Handle<Object> target) {
+	crc32_init();
+
+	target->Set(NanSymbol("scan"), NanNew<FunctionTemplate>(Scan)->GetFunction());
+}
+
+NODE_MODULE(manifest, Init)
@@ -0,0 +1,282 @@
+#include <node.h>
+#include <node_buffer.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include "nan.h"
+#include "zip.h"
+
+using namespace v8;
+
+static Local<Object> EntryToObject(const zip_entry &entry) {
+	Local<Object> object = NanNew<Object>();
+	object->Set(NanSymbol("name"), NanNew<String>(entry.name.data(), (int)entry.name.size()));
+	object->Set(NanSymbol("method"), NanNew<Integer>(entry.method));
+	object->Set(NanSymbol("crc"), NanNew<Number>((double)entry.crc));
+	object->Set(NanSymbol("size"), NanNew<Number>((double)entry.size));
+	object->Set(NanSymbol("compressedSize"), NanNew<Number>((double)entry.compressed_size));
+	object->Set(NanSymbol("offset"), NanNew<Number>((double)entry.offset));
+	object->Set(NanSymbol("time"), NanNew<Integer>(entry.time));
+	object->Set(NanSymbol("date"), NanNew<Integer>(entry.date));
+	object->Set(NanSymbol("flags"), NanNew<Integer>(entry.flags));
+	return object;
+}
+
+static std::string ToString(Handle<Value> value) {
+	size_t length;
+	char *str = NanCString(value, &length);
+	std::string result(str, length);
+	delete[] str;
+	return result;
+}
+
+static void ObjectToEntry(Local<Object> object, zip_entry *entry) {
+	entry->name = ToString(object->Get(NanSymbol("name")));
+	entry->flags = 0;
+	entry->method = (uint16_t)object->Get(NanSymbol("method"))->Uint32Value();
+	entry->crc = object->Get(NanSymbol("crc"))->Uint32Value();
+	entry->size = object->Get(NanSymbol("size"))->Uint32Value();
+	entry->compressed_size = object->Get(NanSymbol("compressedSize"))->Uint32Value();
+	entry->offset = object->Get(NanSymbol("offset"))->Uint32Value();
+	entry->time = (uint16_t)object->Get(NanSymbol("time"))->Uint32Value();
+	entry->date = (uint16_t)object->Get(NanSymbol("date"))->Uint32Value();
+}
+
+/**
+ * readDirectory(path): returns the pak's entries as { name, method, crc,
+ * size, compressedSize, offset, time, date, flags }.
+ */
+NAN_METHOD(ReadDirectory) {
+	NanScope();
+
+	if (args.Length() < 1 || !args[0]->IsString()) {
+		return NanThrowTypeError("Expected a path");
+	}
+
+	std::string path = ToString(args[0]);
+	std::vector<zip_entry> entries;
+	std::string error;
+
+	if (!zip_read_directory(path.c_str(), &entries, &error)) {
+		return NanThrowError(error.c_str());
+	}
+
+	Local<Array> result = NanNew<Array>((int)entries.size());
+	for (size_t i = 0; i < entries.size(); i++) {
+		result->Set((uint32_t)i, EntryToObject(entries[i]));
+	}
+
+	NanReturnValue(result);
+}
+
+/**
+ * read(path, entry): returns the entry's uncompressed contents, inflated
+ * straight into the returned Buffer.
+ */
+NAN_METHOD(Read) {
+	NanScope();
+
+	if (args.Length() < 2 || !args[0]->IsString() || !args[1]->IsObject()) {
+		return NanThrowTypeError("Expected a path and an entry");
+	}
+
+	std::string path = ToString(args[0]);
+	Local<Object> object = args[1].As<Object>();
+	zip_entry entry;
+	ObjectToEntry(object, &entry);
+	entry.flags = (uint16_t)object->Get(NanSymbol("flags"))->Uint32Value();
+
+	Local<Object> buffer = NanNewBufferHandle(entry.size);
+	std::string error;
+
+	if (!zip_read_entry(path.c_str(), entry, (uint8_t *)node::Buffer::Data(buffer), &error)) {
+		return NanThrowError(error.c_str());
+	}
+
+	NanReturnValue(buffer);
+}
+
+/*
+ * Reads and compresses one loose file on a libuv threadpool worker.
+ */
+class DeflateWorker : public NanAsyncWorker {
+public:
+	DeflateWorker(NanCallback *callback, const std::string &path)
+		: NanAsyncWorker(callback), path(path) {}
+
+	void Execute() {
+		ok = false;
+
+		FILE *fp = fopen(path.c_str(), "rb");
+		struct stat st;
+
+		if (!fp || fstat(fileno(fp), &st) == -1) {
+			error = zip_errno("open", path);
+			if (fp) fclose(fp);
+			return;
+		}
+
+		std::vector<uint8_t> data(st.st_size > 0 ? st.st_size : 1);
+		size_t read = st.st_size > 0 ? fread(&data[0], 1, st.st_size, fp) : 0;
+		fclose(fp);
+
+		if (read != (size_t)st.st_size) {
+			error = zip_errno("read", path);
+			return;
+		}
+
+		entry.flags = 0;
+		entry.offset = 0;
+		zip_dos_time(st.st_mtime, &entry.time, &entry.date);
+
+		if (!zip_deflate(&data[0], read, &entry, &compressed)) {
+			error = "failed to compress '" + path + "'";
+			return;
+		}
+
+		ok = true;
+	}
+
+	void HandleOKCallback() {
+		NanScope();
+
+		if (!ok) {
+			Local<Value> argv[] = { NanError(error.c_str()) };
+			callback->Call(1, argv);
+			return;
+		}
+
+		Local<Object> result = EntryToObject(entry);
+		result->Set(NanSymbol("data"), NanNewBufferHandle(
+			compressed.empty() ? "" : (const char *)&compressed[0], (uint32_t)compressed.size()));
+
+		Local<Value> argv[] = { NanNull(), result };
+		callback->Call(2, argv);
+	}
+
+private:
+	std::string path;
+	std::string error;
+	zip_entry entry;
+	std::vector<uint8_t> compressed;
+	bool ok;
+};
+
+/**
+ * deflate(path, callback): calls back with (err, entry) where entry has
+ * the file's method, crc, sizes and modification time, and `data` holds
+ * its compressed contents ready to be written with write().
+ */
+NAN_METHOD(Deflate) {
+	NanScope();
+
+	if (args.Length() < 2 || !args[0]->IsString() || !args[1]->IsFunction()) {
+		return NanThrowTypeError("Expected a path and a callback");
+	}
+
+	NanCallback *callback = new NanCallback(args[1].As<Function>());
+	NanAsyncQueueWorker(new DeflateWorker(callback, ToString(args[0])));
+
+	NanReturnUndefined();
+}
+
+/*
+ * Writes a whole pak on a libuv threadpool worker. The entries array is
+ * kept alive for as long as the worker points into its Buffers.
+ */
+class WriteWorker : public NanAsyncWorker {
+public:
+	WriteWorker(NanCallback *callback, const std::string &path, Local<Object> array)
+		: NanAsyncWorker(callback), path(path) {
+		SaveToPersistent("entries", array);
+	}
+
+	void Execute() {
+		ok = zip_write(path.c_str(), entries, &error);
+	}
+
+	void HandleOKCallback() {
+		NanScope();
+
+		if (!ok) {
+			Local<Value> argv[] = { NanError(error.c_str()) };
+			callback->Call(1, argv);
+			return;
+		}
+
+		Local<Value> argv[] = { NanNull() };
+		callback->Call(1, argv);
+	}
+
+	std::vector<zip_write_entry> entries;
+
+private:
+	std::string path;
+	std::string error;
+	bool ok;
+};
+
+/**
+ * write(path, entries, callback): writes a new pak in one pass. Each entry
+ * is as returned by readDirectory() plus the `pak` it's in, whose already
+ * compressed data is copied over verbatim, or as returned by deflate(),
+ * whose `data` is written.
+ */
+NAN_METHOD(Write) {
+	NanScope();
+
+	if (args.Length() < 3 || !args[0]->IsString() || !args[1]->IsArray() || !args[2]->IsFunction()) {
+		return NanThrowTypeError("Expected a path, an array of entries and a callback");
+	}
+
+	Local<Array> entries = args[1].As<Array>();
+	std::vector<zip_write_entry> items(entries->Length());
+
+	for (uint32_t i = 0; i < entries->Length(); i++) {
+		if (!entries->Get(i)->IsObject()) {
+			return NanThrowTypeError("Expected an array of entries");
+		}
+
+		Local<Object> object = entries->Get(i).As<Object>();
+		Local<Value> data = object->Get(NanSymbol("data"));
+		zip_write_entry &item = items[i];
+
+		ObjectToEntry(object, &item.entry);
+
+		if (item.entry.name.size() > 0xffff) {
+			return NanThrowRangeError("Entry name too long");
+		}
+
+		if (node::Buffer::HasInstance(data)) {
+			if (node::Buffer::Length(data.As<Object>()) != item.entry.compressed_size) {
+				return NanThrowRangeError("Entry data doesn't match its compressed size");
+			}
+			item.data = (const uint8_t *)node::Buffer::Data(data.As<Object>());
+			item.source_offset = 0;
+		} else if (object->Get(NanSymbol("pak"))->IsString()) {
+			item.data = NULL;
+			item.source = ToString(object->Get(NanSymbol("pak")));
+			item.source_offset = item.entry.offset;
+		} else {
+			return NanThrowTypeError("Expected entries with data or a source pak");
+		}
+	}
+
+	NanCallback *callback = new NanCallback(args[2].As<Function>());
+	WriteWorker *worker = new WriteWorker(callback, ToString(args[0]), entries);
+	worker->entries.swap(items);
+	NanAsyncQueueWorker(worker);
+
+	NanReturnUndefined();
+}
+
+void Init(Handle<Object> target) {
+	crc32_init();
+
+	target->Set(NanSymbol("readDirectory"), NanNew<FunctionTemplate>(ReadDirectory)->GetFunction());
+	target->Set(NanSymbol("read"), NanNew<FunctionTemplate>(Read)->GetFunction());
+	target->Set(NanSymbol("deflate"), NanNew<FunctionTemplate>(Deflate)->GetFunction());
+	target->Set(NanSymbol("write"), NanNew<FunctionTemplate>(Write)->GetFunction());
+}
+
+NODE_MODULE(pk3, Init)
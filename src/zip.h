@@ -0,0 +1,495 @@
+#ifndef QUAKEJS_ZIP_H
+#define QUAKEJS_ZIP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "crc32.h"
+
+/*
+ * Just enough of the zip format to repack pk3s: reading the central
+ * directory, inflating single entries, deflating loose files and writing
+ * archives whose entries are either copied verbatim (still compressed) out
+ * of another archive or taken from memory. No zip64, encryption or
+ * spanning, none of which pk3s use.
+ */
+
+#define ZIP_LOCAL_HEADER_SIZE 30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_END_SIZE 22
+
+#define ZIP_LOCAL_SIGNATURE 0x04034b50
+#define ZIP_CENTRAL_SIGNATURE 0x02014b50
+#define ZIP_END_SIGNATURE 0x06054b50
+
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+
+struct zip_entry {
+	std::string name;
+	uint16_t flags;
+	uint16_t method;
+	uint16_t time;
+	uint16_t date;
+	uint32_t crc;
+	uint32_t compressed_size;
+	uint32_t size;
+	uint32_t offset;  // of the local header
+};
+
+/*
+ * An entry to write. Its data is `data` if that's set, otherwise the
+ * already compressed data of the entry at `source_offset` in the archive
+ * `source`.
+ */
+struct zip_write_entry {
+	zip_entry entry;
+	const uint8_t *data;
+	std::string source;
+	uint32_t source_offset;
+};
+
+static inline uint16_t zip_get16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t zip_get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void zip_put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static inline void zip_put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static std::string zip_errno(const char *op, const std::string &path)
+{
+	return std::string(strerror(errno)) + ", " + op + " '" + path + "'";
+}
+
+static bool zip_read_at(FILE *fp, long offset, void *buffer, size_t length)
+{
+	return fseek(fp, offset, SEEK_SET) == 0 && fread(buffer, 1, length, fp) == length;
+}
+
+static bool zip_read_directory(const char *path, std::vector<zip_entry> *entries, std::string *error)
+{
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		*error = zip_errno("open", path);
+		return false;
+	}
+
+	// the end of central directory record is followed by at most a 64k comment
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	long tail = size < 0xffff + ZIP_END_SIZE ? size : 0xffff + ZIP_END_SIZE;
+	std::vector<uint8_t> buffer(tail > 0 ? tail : 1);
+
+	if (tail < ZIP_END_SIZE || !zip_read_at(fp, size - tail, &buffer[0], tail)) {
+		*error = std::string("not a zip file '") + path + "'";
+		fclose(fp);
+		return false;
+	}
+
+	const uint8_t *end = NULL;
+	for (long i = tail - ZIP_END_SIZE; i >= 0; i--) {
+		if (zip_get32(&buffer[i]) == ZIP_END_SIGNATURE) {
+			end = &buffer[i];
+			break;
+		}
+	}
+
+	if (!end) {
+		*error = std::string("missing end of central directory in '") + path + "'";
+		fclose(fp);
+		return false;
+	}
+
+	uint16_t count = zip_get16(end + 10);
+	uint32_t directory_size = zip_get32(end + 12);
+	uint32_t directory_offset = zip_get32(end + 16);
+	std::vector<uint8_t> directory(directory_size > 0 ? directory_size : 1);
+
+	if (directory_size && !zip_read_at(fp, directory_offset, &directory[0], directory_size)) {
+		*error = std::string("truncated central directory in '") + path + "'";
+		fclose(fp);
+		return false;
+	}
+	fclose(fp);
+
+	size_t pos = 0;
+	entries->reserve(count);
+	for (uint16_t i = 0; i < count; i++) {
+		const uint8_t *p = &directory[pos];
+
+		if (pos + ZIP_CENTRAL_HEADER_SIZE > directory_size || zip_get32(p) != ZIP_CENTRAL_SIGNATURE) {
+			*error = std::string("corrupt central directory in '") + path + "'";
+			return false;
+		}
+
+		uint16_t name_length = zip_get16(p + 28);
+		uint16_t extra_length = zip_get16(p + 30);
+		uint16_t comment_length = zip_get16(p + 32);
+
+		if (pos + ZIP_CENTRAL_HEADER_SIZE + name_length > directory_size) {
+			*error = std::string("corrupt central directory in '") + path + "'";
+			return false;
+		}
+
+		zip_entry entry;
+		entry.flags = zip_get16(p + 8);
+		entry.method = zip_get16(p + 10);
+		entry.time = zip_get16(p + 12);
+		entry.date = zip_get16(p + 14);
+		entry.crc = zip_get32(p + 16);
+		entry.compressed_size = zip_get32(p + 20);
+		entry.size = zip_get32(p + 24);
+		entry.offset = zip_get32(p + 42);
+		entry.name.assign((const char *)p + ZIP_CENTRAL_HEADER_SIZE, name_length);
+		entries->push_back(entry);
+
+		pos += ZIP_CENTRAL_HEADER_SIZE + name_length + extra_length + comment_length;
+	}
+
+	return true;
+}
+
+/* finds where an entry's data starts, past its variable length local header */
+static bool zip_data_offset(FILE *fp, uint32_t offset, long *data_offset)
+{
+	uint8_t header[ZIP_LOCAL_HEADER_SIZE];
+
+	if (!zip_read_at(fp, offset, header, sizeof(header)) || zip_get32(header) != ZIP_LOCAL_SIGNATURE) {
+		return false;
+	}
+
+	*data_offset = (long)offset + ZIP_LOCAL_HEADER_SIZE + zip_get16(header + 26) + zip_get16(header + 28);
+	return true;
+}
+
+/* inflates an entry into `output`, which must have room for entry.size bytes */
+static bool zip_read_entry(const char *path, const zip_entry &entry, uint8_t *output, std::string *error)
+{
+	if (entry.flags & 1) {
+		*error = "encrypted entry '" + entry.name + "'";
+		return false;
+	}
+
+	if (entry.method != ZIP_STORED && entry.method != ZIP_DEFLATED) {
+		*error = "unsupported compression method for '" + entry.name + "'";
+		return false;
+	}
+
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		*error = zip_errno("open", path);
+		return false;
+	}
+
+	long offset;
+	std::vector<uint8_t> compressed(entry.compressed_size > 0 ? entry.compressed_size : 1);
+	bool ok = zip_data_offset(fp, entry.offset, &offset) &&
+	          (entry.compressed_size == 0 || zip_read_at(fp, offset, &compressed[0], entry.compressed_size));
+	fclose(fp);
+
+	if (!ok) {
+		*error = "truncated entry '" + entry.name + "' in '" + path + "'";
+		return false;
+	}
+
+	if (entry.method == ZIP_STORED) {
+		if (entry.compressed_size != entry.size) {
+			*error = "corrupt entry '" + entry.name + "' in '" + path + "'";
+			return false;
+		}
+		memcpy(output, &compressed[0], entry.size);
+	} else {
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+
+		if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+			*error = "failed to initialize zlib";
+			return false;
+		}
+
+		zs.next_in = &compressed[0];
+		zs.avail_in = entry.compressed_size;
+		zs.next_out = output;
+		zs.avail_out = entry.size;
+
+		int ret = inflate(&zs, Z_FINISH);
+		bool complete = ret == Z_STREAM_END && zs.total_out == entry.size;
+		inflateEnd(&zs);
+
+		if (!complete) {
+			*error = "corrupt entry '" + entry.name + "' in '" + path + "'";
+			return false;
+		}
+	}
+
+	if (crc32_update(0, output, entry.size) != entry.crc) {
+		*error = "crc mismatch for '" + entry.name + "' in '" + path + "'";
+		return false;
+	}
+
+	return true;
+}
+
+static void zip_dos_time(time_t t, uint16_t *time, uint16_t *date)
+{
+	struct tm tm;
+#ifdef _WIN32
+	localtime_s(&tm, &t);
+#else
+	localtime_r(&t, &tm);
+#endif
+
+	if (tm.tm_year < 80) {
+		*time = 0;
+		*date = (1 << 5) | 1;  // 1980-01-01
+		return;
+	}
+
+	*time = (uint16_t)((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+	*date = (uint16_t)(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+}
+
+/*
+ * Compresses `length` bytes into `output`, filling in the entry's method,
+ * crc and sizes. Data that doesn't get smaller is stored instead.
+ */
+static bool zip_deflate(const uint8_t *data, size_t length, zip_entry *entry, std::vector<uint8_t> *output)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return false;
+	}
+
+	output->resize(deflateBound(&zs, (uLong)length));
+	zs.next_in = (Bytef *)data;
+	zs.avail_in = (uInt)length;
+	zs.next_out = output->empty() ? NULL : &(*output)[0];
+	zs.avail_out = (uInt)output->size();
+
+	int ret = deflate(&zs, Z_FINISH);
+	size_t compressed = zs.total_out;
+	deflateEnd(&zs);
+
+	if (ret != Z_STREAM_END) {
+		return false;
+	}
+
+	entry->crc = crc32_update(0, data, length);
+	entry->size = (uint32_t)length;
+
+	if (compressed < length) {
+		entry->method = ZIP_DEFLATED;
+		output->resize(compressed);
+	} else {
+		entry->method = ZIP_STORED;
+		output->assign(data, data + length);
+	}
+	entry->compressed_size = (uint32_t)output->size();
+
+	return true;
+}
+
+static bool zip_copy(FILE *from, long offset, FILE *to, uint32_t length)
+{
+	uint8_t buffer[64 * 1024];
+
+	if (fseek(from, offset, SEEK_SET) != 0) {
+		return false;
+	}
+
+	while (length) {
+		size_t chunk = length < sizeof(buffer) ? length : sizeof(buffer);
+		if (fread(buffer, 1, chunk, from) != chunk || fwrite(buffer, 1, chunk, to) != chunk) {
+			return false;
+		}
+		length -= (uint32_t)chunk;
+	}
+
+	return true;
+}
+
+static void zip_local_header(uint8_t *p, const zip_entry &entry)
+{
+	zip_put32(p, ZIP_LOCAL_SIGNATURE);
+	zip_put16(p + 4, 20);  // version needed to extract
+	zip_put16(p + 6, 0);   // flags, sizes are known up front
+	zip_put16(p + 8, entry.method);
+	zip_put16(p + 10, entry.time);
+	zip_put16(p + 12, entry.date);
+	zip_put32(p + 14, entry.crc);
+	zip_put32(p + 18, entry.compressed_size);
+	zip_put32(p + 22, entry.size);
+	zip_put16(p + 26, (uint16_t)entry.name.size());
+	zip_put16(p + 28, 0);  // extra field length
+}
+
+static void zip_central_header(uint8_t *p, const zip_entry &entry, uint32_t offset)
+{
+	zip_put32(p, ZIP_CENTRAL_SIGNATURE);
+	zip_put16(p + 4, 20);  // version made by
+	zip_put16(p + 6, 20);  // version needed to extract
+	zip_put16(p + 8, 0);
+	zip_put16(p + 10, entry.method);
+	zip_put16(p + 12, entry.time);
+	zip_put16(p + 14, entry.date);
+	zip_put32(p + 16, entry.crc);
+	zip_put32(p + 20, entry.compressed_size);
+	zip_put32(p + 24, entry.size);
+	zip_put16(p + 28, (uint16_t)entry.name.size());
+	zip_put16(p + 30, 0);  // extra field length
+	zip_put16(p + 32, 0);  // comment length
+	zip_put16(p + 34, 0);  // disk number
+	zip_put16(p + 36, 0);  // internal attributes
+	zip_put32(p + 38, 0);  // external attributes
+	zip_put32(p + 42, offset);
+}
+
+/* writes a complete archive in one pass */
+static bool zip_write(const char *path, const std::vector<zip_write_entry> &entries, std::string *error)
+{
+	if (entries.size() > 0xffff) {
+		*error = std::string("too many entries for '") + path + "'";
+		return false;
+	}
+
+	FILE *out = fopen(path, "wb");
+	if (!out) {
+		*error = zip_errno("open", path);
+		return false;
+	}
+
+	std::vector<uint32_t> offsets(entries.size());
+	uint64_t offset = 0;
+	FILE *source = NULL;
+	std::string source_path;
+	bool ok = true;
+
+	for (size_t i = 0; ok && i < entries.size(); i++) {
+		const zip_write_entry &item = entries[i];
+		const zip_entry &entry = item.entry;
+		uint8_t header[ZIP_LOCAL_HEADER_SIZE];
+
+		if (offset + ZIP_LOCAL_HEADER_SIZE + entry.name.size() + entry.compressed_size > 0xffffffffULL) {
+			*error = std::string("archive too large '") + path + "'";
+			ok = false;
+			break;
+		}
+
+		offsets[i] = (uint32_t)offset;
+		zip_local_header(header, entry);
+
+		if (fwrite(header, 1, sizeof(header), out) != sizeof(header) ||
+		    fwrite(entry.name.data(), 1, entry.name.size(), out) != entry.name.size()) {
+			*error = zip_errno("write", path);
+			ok = false;
+			break;
+		}
+
+		if (item.data) {
+			if (entry.compressed_size && fwrite(item.data, 1, entry.compressed_size, out) != entry.compressed_size) {
+				*error = zip_errno("write", path);
+				ok = false;
+			}
+		} else {
+			// consecutive entries usually come from the same source archive
+			if (!source || source_path != item.source) {
+				if (source) fclose(source);
+				source_path = item.source;
+				source = fopen(source_path.c_str(), "rb");
+			}
+
+			long data_offset;
+			if (!source) {
+				*error = zip_errno("open", item.source);
+				ok = false;
+			} else if (!zip_data_offset(source, item.source_offset, &data_offset) ||
+			           !zip_copy(source, data_offset, out, entry.compressed_size)) {
+				*error = "failed to copy '" + entry.name + "' from '" + item.source + "' to '" + path + "'";
+				ok = false;
+			}
+		}
+
+		offset += ZIP_LOCAL_HEADER_SIZE + entry.name.size() + entry.compressed_size;
+	}
+
+	if (source) {
+		fclose(source);
+	}
+
+	uint64_t directory_offset = offset;
+
+	for (size_t i = 0; ok && i < entries.size(); i++) {
+		const zip_entry &entry = entries[i].entry;
+		uint8_t header[ZIP_CENTRAL_HEADER_SIZE];
+
+		zip_central_header(header, entry, offsets[i]);
+
+		if (fwrite(header, 1, sizeof(header), out) != sizeof(header) ||
+		    fwrite(entry.name.data(), 1, entry.name.size(), out) != entry.name.size()) {
+			*error = zip_errno("write", path);
+			ok = false;
+		}
+
+		offset += ZIP_CENTRAL_HEADER_SIZE + entry.name.size();
+	}
+
+	if (ok && offset > 0xffffffffULL) {
+		*error = std::string("archive too large '") + path + "'";
+		ok = false;
+	}
+
+	if (ok) {
+		uint8_t end[ZIP_END_SIZE];
+		zip_put32(end, ZIP_END_SIGNATURE);
+		zip_put16(end + 4, 0);
+		zip_put16(end + 6, 0);
+		zip_put16(end + 8, (uint16_t)entries.size());
+		zip_put16(end + 10, (uint16_t)entries.size());
+		zip_put32(end + 12, (uint32_t)(offset - directory_offset));
+		zip_put32(end + 16, (uint32_t)directory_offset);
+		zip_put16(end + 20, 0);
+
+		if (fwrite(end, 1, sizeof(end), out) != sizeof(end)) {
+			*error = zip_errno("write", path);
+			ok = false;
+		}
+	}
+
+	if (fclose(out) != 0 && ok) {
+		*error = zip_errno("write", path);
+		ok = false;
+	}
+
+	if (!ok) {
+		remove(path);
+	}
+
+	return ok;
+}
+
+#endif // QUAKEJS_ZIP_H
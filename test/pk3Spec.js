@@ -0,0 +1,172 @@
+/* globals describe, it, before, after */
+
+var assert = require('chai').assert;
+var child_process = require('child_process');
+var crc32 = require('buffer-crc32');
+var crypto = require('crypto');
+var fs = require('fs');
+var path = require('path');
+var pk3 = require('../lib/pk3');
+var temp = require('temp');
+var wrench = require('wrench');
+
+// written by Info-ZIP: a directory, a deflated and a stored entry, and
+// readme.txt streamed with a data descriptor (zip -fd)
+var fixture = path.join(__dirname, 'fixtures', 'pak0.pk3');
+
+function files(entries) {
+	return entries.filter(function (entry) {
+		return entry.name.charAt(entry.name.length - 1) !== '/';
+	});
+}
+
+function byName(entries) {
+	var map = {};
+	entries.forEach(function (entry) {
+		map[entry.name] = entry;
+	});
+	return map;
+}
+
+// copies entries over still compressed, the way repak does
+function fromPak(pak, entries) {
+	return entries.map(function (entry) {
+		entry.pak = pak;
+		return entry;
+	});
+}
+
+function deflate(dir, name, data, callback) {
+	var file = path.join(dir, path.basename(name));
+	fs.writeFileSync(file, data);
+
+	pk3.deflate(file, function (err, entry) {
+		if (err) return callback(err);
+		entry.name = name;
+		callback(null, entry);
+	});
+}
+
+function unzipTest(pak, callback) {
+	child_process.execFile('unzip', ['-t', pak], function (err, stdout) {
+		if (err) return callback(new Error('unzip -t ' + pak + ' failed:\n' + stdout));
+		callback();
+	});
+}
+
+describe('pk3', function() {
+	var dir;
+
+	before(function() {
+		dir = temp.mkdirSync('pk3');
+	});
+
+	after(function() {
+		wrench.rmdirSyncRecursive(dir);
+	});
+
+	it ('should read a directory', function() {
+		var entries = byName(pk3.readDirectory(fixture));
+
+		assert.deepEqual(Object.keys(entries).sort(), ['maps/blob.bin', 'readme.txt', 'scripts/', 'scripts/test.shader']);
+		assert.equal(entries['scripts/test.shader'].method, 8);
+		assert.equal(entries['scripts/test.shader'].size, 2540);
+		assert.equal(entries['maps/blob.bin'].method, 0);
+		assert.equal(entries['maps/blob.bin'].compressedSize, 1500);
+		assert.ok(entries['readme.txt'].flags & 8);
+	});
+
+	it ('should read stored, deflated and streamed entries', function() {
+		files(pk3.readDirectory(fixture)).forEach(function (entry) {
+			var data = pk3.read(fixture, entry);
+			assert.equal(data.length, entry.size);
+			assert.equal(crc32.unsigned(data), entry.crc);
+		});
+	});
+
+	it ('should store data that does not compress', function(done) {
+		var data = crypto.randomBytes(4096);
+
+		deflate(dir, 'random.bin', data, function (err, entry) {
+			assert.isNull(err);
+			assert.equal(entry.method, 0);
+			assert.equal(entry.compressedSize, data.length);
+			assert.equal(entry.crc, crc32.unsigned(data));
+			done();
+		});
+	});
+
+	it ('should copy entries and add new ones', function(done) {
+		var source = files(pk3.readDirectory(fixture));
+		var text = new Buffer(new Array(1000).join('sound/world/wind.opus\n'));
+		var pak = path.join(dir, 'roundtrip.pk3');
+
+		deflate(dir, 'scripts/sounds.txt', text, function (err, added) {
+			assert.isNull(err);
+			assert.equal(added.method, 8);
+
+			pk3.write(pak, fromPak(fixture, source).concat([added]), function (err) {
+				assert.isNull(err);
+
+				unzipTest(pak, function (err) {
+					assert.isUndefined(err);
+
+					var written = byName(pk3.readDirectory(pak));
+					assert.deepEqual(Object.keys(written).sort(), ['maps/blob.bin', 'readme.txt', 'scripts/sounds.txt', 'scripts/test.shader']);
+
+					// copied entries keep their compressed data, minus the data descriptor
+					source.forEach(function (entry) {
+						var copy = written[entry.name];
+						assert.equal(copy.method, entry.method);
+						assert.equal(copy.compressedSize, entry.compressedSize);
+						assert.equal(copy.crc, entry.crc);
+						assert.equal(copy.flags & 8, 0);
+						assert.equal(pk3.read(pak, copy).toString('binary'), pk3.read(fixture, entry).toString('binary'));
+					});
+
+					assert.equal(pk3.read(pak, written['scripts/sounds.txt']).toString(), text.toString());
+					done();
+				});
+			});
+		});
+	});
+
+	it ('should split into pakNNN.pk3 under the size limit', function(done) {
+		var source = fromPak(fixture, files(pk3.readDirectory(fixture)));
+		var maxSize = 2048;
+		var parts = pk3.split(path.join(dir, 'pak.pk3'), source, maxSize);
+
+		assert.deepEqual(parts.map(function (part) { return path.basename(part.name); }), ['pak100.pk3', 'pak101.pk3']);
+		assert.equal(parts[0].entries.length + parts[1].entries.length, source.length);
+
+		var remaining = parts.length;
+		parts.forEach(function (part) {
+			pk3.write(part.name, part.entries, function (err) {
+				assert.isNull(err);
+				assert.ok(fs.statSync(part.name).size < maxSize);
+
+				unzipTest(part.name, function (err) {
+					assert.isUndefined(err);
+					if (--remaining === 0) done();
+				});
+			});
+		});
+	});
+
+	it ('should give an entry over the size limit a pak of its own', function() {
+		var source = files(pk3.readDirectory(fixture));
+		var parts = pk3.split('pak.pk3', source, 1024);
+
+		assert.deepEqual(parts.map(function (part) { return part.name; }), ['pak100.pk3', 'pak101.pk3', 'pak102.pk3']);
+		assert.deepEqual(parts[1].entries.map(function (entry) { return entry.name; }), ['maps/blob.bin']);
+	});
+
+	it ('should not split without a size limit', function() {
+		var source = files(pk3.readDirectory(fixture));
+		var parts = pk3.split('pak.pk3', source);
+
+		assert.equal(parts.length, 1);
+		assert.equal(parts[0].name, 'pak.pk3');
+		assert.equal(parts[0].entries.length, source.length);
+	});
+});
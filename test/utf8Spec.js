@@ -0,0 +1,297 @@
+/* globals describe, it */
+
+var assert = require('chai').assert;
+var Receiver = require('ws/lib/Receiver');
+var Validation = require('ws/lib/Validation').Validation;
+
+// without a compiled validation.node ws accepts any text, so there's
+// nothing to check
+var native = Validation !== require('ws/lib/Validation.fallback').Validation;
+var describeNative = native ? describe : describe.skip;
+
+var MASK = new Buffer([0x37, 0xfa, 0x21, 0x3d]);
+
+var valid = {
+	'empty': [],
+	'ascii': [0x67, 0x67, 0x20, 0x77, 0x70],
+	'U+0080': [0xc2, 0x80],
+	'U+07FF': [0xdf, 0xbf],
+	'U+0800': [0xe0, 0xa0, 0x80],
+	'U+D7FF': [0xed, 0x9f, 0xbf],
+	'U+E000': [0xee, 0x80, 0x80],
+	'U+FFFF': [0xef, 0xbf, 0xbf],
+	'U+10000': [0xf0, 0x90, 0x80, 0x80],
+	'U+10FFFF': [0xf4, 0x8f, 0xbf, 0xbf],
+	'mixed text': Array.prototype.slice.call(new Buffer('café 你好 😀!'))
+};
+
+var invalid = {
+	'overlong NUL': [0xc0, 0x80],
+	'overlong 2 byte form': [0xc1, 0xbf],
+	'overlong 3 byte form': [0xe0, 0x80, 0x80],
+	'overlong U+07FF': [0xe0, 0x9f, 0xbf],
+	'overlong 4 byte form': [0xf0, 0x80, 0x80, 0x80],
+	'overlong U+FFFF': [0xf0, 0x8f, 0xbf, 0xbf],
+	'high surrogate': [0xed, 0xa0, 0x80],
+	'low surrogate': [0xed, 0xbf, 0xbf],
+	'U+110000': [0xf4, 0x90, 0x80, 0x80],
+	'F5 lead byte': [0xf5, 0x80, 0x80, 0x80],
+	'FF byte': [0xff],
+	'lone continuation byte': [0x80],
+	'ED followed by ASCII': [0xed, 0x41, 0x41],
+	'F4 followed by ASCII': [0xf4, 0x41, 0x41, 0x41],
+	'truncated 2 byte sequence': [0x41, 0xc2],
+	'truncated 3 byte sequence': [0x41, 0xe2, 0x82],
+	'truncated 4 byte sequence': [0x41, 0xf0, 0x9f, 0x98]
+};
+
+// ASCII on both sides of `bytes`, long enough for the vectorized paths
+function pad(before, bytes, after) {
+	var buffer = new Buffer(before + bytes.length + after);
+	buffer.fill(0x61);
+	new Buffer(bytes).copy(buffer, before);
+	return buffer;
+}
+
+function mask(data) {
+	var masked = new Buffer(data.length);
+	for (var i = 0; i < data.length; i++) masked[i] = data[i] ^ MASK[i % 4];
+	return masked;
+}
+
+// a text (1), continuation (0) or binary (2) frame, masked unless a client
+// is receiving it
+function frame(opcode, fin, data, unmasked) {
+	var length = data.length;
+	var header = length < 126 ?
+		new Buffer([0, length]) :
+		new Buffer([0, 126, length >> 8, length & 0xff]);
+
+	header[0] = (fin ? 0x80 : 0) | opcode;
+	if (unmasked) return Buffer.concat([header, data]);
+
+	header[1] |= 0x80;
+	return Buffer.concat([header, MASK, mask(data)]);
+}
+
+function receive(frames) {
+	var receiver = new Receiver();
+	var result = { texts: [], binary: [], errors: [] };
+
+	receiver.ontext = function (text) { result.texts.push(text); };
+	receiver.onbinary = function (data) { result.binary.push(data); };
+	receiver.onerror = function (reason, code) { result.errors.push(code); };
+	receiver.onping = function () {};
+	frames.forEach(function (data) { receiver.add(data); });
+	receiver.cleanup();
+
+	return result;
+}
+
+describeNative('Validation', function() {
+	it ('should accept valid UTF-8', function() {
+		Object.keys(valid).forEach(function (name) {
+			assert.ok(Validation.isValidUTF8(new Buffer(valid[name])), name);
+		});
+	});
+
+	it ('should reject invalid UTF-8', function() {
+		Object.keys(invalid).forEach(function (name) {
+			assert.ok(!Validation.isValidUTF8(new Buffer(invalid[name])), name);
+		});
+	});
+
+	it ('should find invalid sequences anywhere in a long buffer', function() {
+		Object.keys(invalid).forEach(function (name) {
+			// a truncated sequence has to end the buffer
+			var after = /truncated/.test(name) ? 0 : 80;
+			for (var offset = 0; offset < 80; offset++) {
+				assert.ok(!Validation.isValidUTF8(pad(offset, invalid[name], after)), name + ' at ' + offset);
+			}
+		});
+	});
+
+	it ('should accept characters anywhere in a long buffer', function() {
+		Object.keys(valid).forEach(function (name) {
+			for (var offset = 0; offset < 80; offset++) {
+				assert.ok(Validation.isValidUTF8(pad(offset, valid[name], 80)), name + ' at ' + offset);
+			}
+		});
+	});
+
+	it ('should carry sequences split across update() calls', function() {
+		var validation = new Validation();
+
+		Object.keys(valid).forEach(function (name) {
+			var data = pad(40, valid[name], 40);
+			for (var split = 0; split <= data.length; split++) {
+				assert.ok(validation.update(data.slice(0, split)), name + ' split at ' + split);
+				assert.ok(validation.update(data.slice(split)), name + ' split at ' + split);
+				assert.ok(validation.finish(), name + ' split at ' + split);
+			}
+		});
+	});
+
+	it ('should reject invalid sequences split across update() calls', function() {
+		var validation = new Validation();
+
+		Object.keys(invalid).forEach(function (name) {
+			var data = pad(40, invalid[name], 0);
+			for (var split = 0; split <= data.length; split++) {
+				var ok = validation.update(data.slice(0, split));
+				ok = validation.update(data.slice(split)) && ok;
+				ok = validation.finish() && ok;
+				assert.ok(!ok, name + ' split at ' + split);
+			}
+		});
+	});
+
+	it ('should reset on finish()', function() {
+		var validation = new Validation();
+
+		assert.ok(validation.update(new Buffer([0xe2, 0x82])));
+		assert.ok(!validation.finish());
+		assert.ok(validation.update(new Buffer('abc')));
+		assert.ok(validation.finish());
+
+		assert.ok(!validation.update(new Buffer([0xc0, 0x80])));
+		assert.ok(!validation.update(new Buffer('abc')));
+		assert.ok(!validation.finish());
+		assert.ok(validation.update(new Buffer('abc')));
+		assert.ok(validation.finish());
+	});
+
+	it ('should unmask and validate in one pass', function() {
+		var validation = new Validation();
+
+		Object.keys(valid).forEach(function (name) {
+			var data = pad(3000, valid[name], 3000);
+			var output = new Buffer(data.length + 1);
+
+			assert.equal(validation.unmask(mask(data), MASK, output, 1), data.length, name);
+			assert.ok(validation.finish(), name);
+			assert.equal(output.slice(1).toString('hex'), data.toString('hex'), name);
+		});
+	});
+
+	it ('should unmask in place and copy without a mask', function() {
+		var validation = new Validation();
+		var data = pad(100, valid['mixed text'], 100);
+		var masked = mask(data);
+		var output = new Buffer(data.length);
+
+		assert.equal(validation.unmask(masked, MASK, masked, 0), data.length);
+		assert.ok(validation.finish());
+		assert.equal(masked.toString('hex'), data.toString('hex'));
+
+		assert.equal(validation.unmask(data, null, output, 0), data.length);
+		assert.ok(validation.finish());
+		assert.equal(output.toString('hex'), data.toString('hex'));
+	});
+
+	it ('should reject invalid sequences while unmasking', function() {
+		var validation = new Validation();
+
+		Object.keys(invalid).forEach(function (name) {
+			// past the first block the unmasking is done in
+			var data = pad(4097, invalid[name], 0);
+			var ok = validation.unmask(mask(data), MASK, new Buffer(data.length), 0) >= 0;
+			assert.ok(!(ok && validation.finish()), name);
+			validation.finish();
+		});
+	});
+
+	it ('should carry sequences split across unmask() calls', function() {
+		var validation = new Validation();
+		var data = new Buffer('😀');
+		var output = new Buffer(data.length);
+
+		for (var split = 0; split <= data.length; split++) {
+			// every fragment has a mask of its own
+			assert.equal(validation.unmask(mask(data.slice(0, split)), MASK, output, 0), split);
+			assert.equal(validation.unmask(mask(data.slice(split)), MASK, output, split), data.length - split);
+			assert.ok(validation.finish(), 'split at ' + split);
+			assert.equal(output.toString('hex'), data.toString('hex'));
+		}
+	});
+
+	it ('should throw if the output is too small', function() {
+		var validation = new Validation();
+
+		assert.throws(function () {
+			validation.unmask(new Buffer(8), MASK, new Buffer(8), 1);
+		}, RangeError);
+	});
+});
+
+describeNative('Receiver', function() {
+	var text = 'gg wp café 你好 😀';
+	var data = new Buffer(text);
+
+	it ('should pass on valid text messages', function() {
+		var long = pad(1000, data, 1000);
+		var result = receive([frame(1, true, data), frame(1, true, long), frame(1, true, data, true)]);
+
+		assert.equal(result.errors.length, 0);
+		assert.equal(result.texts.length, 3);
+		assert.equal(result.texts[0], text);
+		assert.equal(result.texts[1], long.toString());
+		assert.equal(result.texts[2], text);
+	});
+
+	it ('should close with 1007 on an invalid text message', function() {
+		Object.keys(invalid).forEach(function (name) {
+			var result = receive([frame(1, true, pad(200, invalid[name], 0))]);
+
+			assert.equal(result.texts.length, 0, name);
+			assert.equal(result.errors[0], 1007, name);
+		});
+	});
+
+	it ('should join characters split across fragments', function() {
+		for (var split = 0; split <= data.length; split++) {
+			var result = receive([
+				frame(1, false, data.slice(0, split)),
+				frame(9, true, new Buffer('ping')),
+				frame(0, true, data.slice(split))
+			]);
+
+			assert.equal(result.errors.length, 0, 'split at ' + split);
+			assert.equal(result.texts[0], text, 'split at ' + split);
+		}
+	});
+
+	it ('should close with 1007 on an invalid fragmented message', function() {
+		Object.keys(invalid).forEach(function (name) {
+			var bytes = pad(20, invalid[name], 0);
+
+			for (var split = 0; split <= bytes.length; split++) {
+				var result = receive([frame(1, false, bytes.slice(0, split)), frame(0, true, bytes.slice(split))]);
+
+				assert.equal(result.texts.length, 0, name + ' split at ' + split);
+				assert.equal(result.errors[0], 1007, name + ' split at ' + split);
+			}
+		});
+	});
+
+	it ('should check each message on its own', function() {
+		var result = receive([frame(1, true, new Buffer([0x61, 0xe2, 0x82])), frame(1, true, new Buffer([0xac]))]);
+		assert.equal(result.texts.length, 0);
+		assert.equal(result.errors[0], 1007);
+
+		result = receive([
+			frame(1, false, new Buffer([0x61])),
+			frame(0, true, new Buffer([0xe2, 0x82, 0xac])),
+			frame(1, true, new Buffer([0x62]))
+		]);
+		assert.equal(result.errors.length, 0);
+		assert.equal(result.texts.join(), 'a\u20ac,b');
+	});
+
+	it ('should not validate binary messages', function() {
+		var result = receive([frame(2, true, new Buffer([0xc0, 0x80, 0xff]))]);
+
+		assert.equal(result.errors.length, 0);
+		assert.equal(result.binary[0].toString('hex'), 'c080ff');
+	});
+});